@@ -0,0 +1,320 @@
+// fuzz.c
+// Recursive Descent Parser for Control Structures and Nested Expressions
+// Fuzz target for the parser library (parser.c): LLVMFuzzerTestOneInput for libFuzzer,
+// and with -DRDP_FUZZ_STANDALONE a driver of its own for machines without libFuzzer.
+// Course: Programming Languages and Structures
+// Code by: Md. Alamin
+// Student ID: 134
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+
+// --- Configuration ---
+
+#define FUZZ_MAX_INPUT (64 * 1024)      // Longer inputs are cut
+#define FUZZ_HEAP_SIZE (16 * 1024 * 1024) // Memory one run may use
+#define FUZZ_MAX_DEPTH 256              // Keeps deep nesting from overflowing the stack
+#define FUZZ_MAX_LOOP_ITERATIONS 1000   // Without assignment every loop that iterates is a runaway
+
+// --- Memory ---
+// The library allocates through these hooks from one static region, which is reset
+// before every call, so no run reaches malloc. A run that needs more than the region
+// fails with PARSER_OUT_OF_MEMORY, which is a verdict like any other.
+
+typedef struct {
+    unsigned char *memory;
+    size_t size;
+    size_t used;
+} FuzzHeap;
+
+static unsigned char g_heap_memory[FUZZ_HEAP_SIZE] __attribute__((aligned(16)));
+static FuzzHeap g_heap = {g_heap_memory, FUZZ_HEAP_SIZE, 0};
+
+static void* fuzz_alloc(size_t size, void* context) {
+    FuzzHeap* heap = (FuzzHeap*)context;
+    size = (size + 15) & ~(size_t)15;
+    if (size > heap->size - heap->used) {
+        return NULL;
+    }
+    void* memory = heap->memory + heap->used;
+    heap->used += size;
+    return memory;
+}
+
+static void fuzz_free(void* memory, size_t size, void* context) {
+    (void)memory; // Released all at once by the next reset
+    (void)size;
+    (void)context;
+}
+
+static const ParserAllocator g_fuzz_allocator = {fuzz_alloc, fuzz_free, &g_heap};
+
+// The lexer stops at a NUL, which fuzzer inputs do not have, so each input is copied
+// behind this one sentinel; an embedded NUL simply ends the program early. The copy
+// ends at the end of the buffer, so that reading past the NUL leaves the array (and
+// hits its redzone under AddressSanitizer) as it would leave a heap block.
+static char g_input_buffer[FUZZ_MAX_INPUT + 1];
+static const char* g_input = g_input_buffer;
+
+// Runs one engine on g_input with a fresh heap. Nothing is printed: the trace is off
+// and the library reports errors as values.
+static ParserStatus fuzz_run(ParserMode mode, int hash_cons, int optimize, ParserResult* result) {
+    ParserOptions options;
+    parser_default_options(&options);
+    options.mode = mode;
+    options.build_tree = mode == PARSER_PARSE;
+    options.hash_cons = hash_cons;
+    options.optimize = optimize;
+    options.allocator = &g_fuzz_allocator;
+    options.max_loop_iterations = FUZZ_MAX_LOOP_ITERATIONS;
+    options.limits.max_depth = FUZZ_MAX_DEPTH;
+
+    g_heap.used = 0;
+    parser_process(g_input, &options, result);
+    parser_free_result(result);
+    return result->status;
+}
+
+// A verdict both engines can disagree on: limits and memory depend on how far each got
+static int comparable(ParserStatus status) {
+    return status == PARSER_OK || status == PARSER_SYNTAX_ERROR || status == PARSER_RUNTIME_ERROR;
+}
+
+// The engines check each other; a disagreement is a bug and aborts, which the fuzzer
+// reports as a crash together with the input.
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    ParserResult validated, evaluated, shared, optimized, filtered;
+
+    if (size > FUZZ_MAX_INPUT) {
+        size = FUZZ_MAX_INPUT;
+    }
+    char* input = g_input_buffer + FUZZ_MAX_INPUT - size;
+    memcpy(input, data, size);
+    input[size] = '\0';
+    g_input = input;
+
+    // The validator and the parser accept the same programs and stop at the same token
+    fuzz_run(PARSER_VALIDATE, 0, 0, &validated);
+    fuzz_run(PARSER_EVALUATE, 0, 0, &evaluated);
+    if (comparable(validated.status) && comparable(evaluated.status)) {
+        int parsed = evaluated.status != PARSER_SYNTAX_ERROR;
+        if ((validated.status == PARSER_OK) != parsed) {
+            abort();
+        }
+        if (!parsed && (validated.error.line != evaluated.error.line || validated.error.col != evaluated.error.col)) {
+            abort();
+        }
+    }
+
+    // The pre-filter only rejects programs the parser rejects too
+    if (fuzz_run(PARSER_PREFILTER, 0, 0, &filtered) == PARSER_SYNTAX_ERROR && validated.status == PARSER_OK) {
+        abort();
+    }
+
+    // Sharing and optimizing change how a program runs, not what it computes
+    if (evaluated.status == PARSER_OK) {
+        if (fuzz_run(PARSER_EVALUATE, 1, 0, &shared) == PARSER_OK && shared.value != evaluated.value) {
+            abort();
+        }
+        if (fuzz_run(PARSER_EVALUATE, 0, 1, &optimized) == PARSER_OK && optimized.value != evaluated.value) {
+            abort();
+        }
+    }
+    return 0;
+}
+
+#ifdef RDP_FUZZ_STANDALONE
+// =============Standalone Driver============== start
+// fuzz [-runs N] [-seed S] [FILE...]
+// Runs every FILE once (to reproduce a crash or replay a corpus). With -runs, then
+// mutates those inputs, or a few built-in programs when there are none, N times and
+// prints the executions per second.
+
+#include <time.h>
+
+#define TEN_IDS(p) p "0;" p "1;" p "2;" p "3;" p "4;" p "5;" p "6;" p "7;" p "8;" p "9;"
+
+static const char* const g_seed_programs[] = {
+    "{ if (a == LTD) { while (b < 100) { (a + b) * (b - LTD); } } else { (x + y) * (a - b); } }",
+    "{ a + b; }",
+    "{ while (i <= 10) { sum + i; i + 1; } }",
+    "{ x / 0; /* comment */ (a * 8) / 4; }",
+    "{ while (LTD > 0) { a * 4 + b; if (a != b) { c; } } }",
+    // Overflow and INT_MIN / -1, which the engines must all wrap
+    "{ (0 - 2147483647 - 1) / (0 - 1); 2147483647 + 1; (0 - 2147483647 - 1) * (0 - 1); 65536 * 65536; }",
+    // More distinct identifiers than a small fixed symbol table holds
+    "{ " TEN_IDS("a") TEN_IDS("b") TEN_IDS("c") TEN_IDS("d") TEN_IDS("e") TEN_IDS("f")
+    TEN_IDS("g") TEN_IDS("h") TEN_IDS("i") TEN_IDS("j") TEN_IDS("k") " a0 + k9; }"
+};
+
+// Fragments a mutation may insert
+static const char* const g_fragments[] = {
+    "{", "}", "(", ")", ";", "if", "else", "while", "LTD", "==", "!=", "<=", ">=", "<", ">",
+    "+", "-", "*", "/", "0", "1", "2147483647", "a", " ", "\n", "/*", "*/", "//",
+    "(0 - 2147483647 - 1)", "(0 - 1)", "65536"
+};
+
+static uint64_t g_rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+    g_rng_state ^= g_rng_state << 13;
+    g_rng_state ^= g_rng_state >> 7;
+    g_rng_state ^= g_rng_state << 17;
+    return g_rng_state;
+}
+
+static char* read_input(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = (char*)malloc(length > 0 ? (size_t)length : 1);
+    if (!data || fread(data, 1, (size_t)length, file) != (size_t)length) {
+        fprintf(stderr, "Error reading %s\n", path);
+        fclose(file);
+        free(data);
+        return NULL;
+    }
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+// One random edit of data in place: overwrite, insert or delete a byte, insert a
+// fragment or a statement with a numbered identifier, or copy a range. Returns the new size.
+static size_t mutate(char* data, size_t size, size_t capacity) {
+    size_t at = size ? (size_t)(next_random() % size) : 0;
+    switch (next_random() % 6) {
+        case 0:
+            if (size) data[at] = (char)next_random();
+            break;
+        case 1:
+            if (size < capacity) {
+                memmove(data + at + 1, data + at, size - at);
+                data[at] = (char)(next_random() % 96 + 32);
+                size++;
+            }
+            break;
+        case 2:
+            if (size) {
+                memmove(data + at, data + at + 1, size - at - 1);
+                size--;
+            }
+            break;
+        case 3: {
+            const char* fragment = g_fragments[next_random() % (sizeof(g_fragments) / sizeof(g_fragments[0]))];
+            size_t length = strlen(fragment);
+            if (size + length <= capacity) {
+                memmove(data + at + length, data + at, size - at);
+                memcpy(data + at, fragment, length);
+                size += length;
+            }
+            break;
+        }
+        case 4: {
+            // A new identifier now and then adds up to many distinct ones
+            char statement[24];
+            size_t length = (size_t)snprintf(statement, sizeof(statement), "v%u;", (unsigned)(next_random() % 100000));
+            if (size + length <= capacity) {
+                memmove(data + at + length, data + at, size - at);
+                memcpy(data + at, statement, length);
+                size += length;
+            }
+            break;
+        }
+        default: {
+            size_t from = size ? (size_t)(next_random() % size) : 0;
+            size_t length = size ? (size_t)(next_random() % (size - from) + 1) : 0;
+            if (length > 64) length = 64;
+            if (size + length <= capacity) {
+                memmove(data + at + length, data + at, size - at);
+                memmove(data + at, data + (from >= at ? from + length : from), length);
+                size += length;
+            }
+            break;
+        }
+    }
+    return size;
+}
+
+int main(int argc, char* argv[]) {
+    long runs = 0;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-runs") == 0) {
+            runs = atol(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-seed") == 0) {
+            g_rng_state = strtoull(argv[arg + 1], NULL, 10) * 2 + 1; // Never 0
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (arg < argc && argv[arg][0] == '-') {
+        fprintf(stderr, "Usage: %s [-runs N] [-seed S] [FILE...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Replay the files; their contents are also the inputs to mutate
+    int input_count = argc - arg;
+    char** inputs = (char**)calloc(input_count > 0 ? (size_t)input_count : 1, sizeof(char*));
+    size_t* sizes = (size_t*)calloc(input_count > 0 ? (size_t)input_count : 1, sizeof(size_t));
+    if (!inputs || !sizes) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < input_count; i++) {
+        inputs[i] = read_input(argv[arg + i], &sizes[i]);
+        if (!inputs[i]) {
+            return EXIT_FAILURE;
+        }
+        LLVMFuzzerTestOneInput((const uint8_t*)inputs[i], sizes[i]);
+    }
+    if (input_count > 0) {
+        printf("Replayed %d input(s).\n", input_count);
+    }
+    if (runs <= 0) {
+        return 0;
+    }
+
+    static char buffer[FUZZ_MAX_INPUT];
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t size = 0;
+    for (long run = 0; run < runs; run++) {
+        // Start again from an input now and then, so that the mutations do not drift off
+        if (run % 64 == 0) {
+            if (input_count > 0) {
+                int i = (int)(next_random() % (uint64_t)input_count);
+                size = sizes[i] < sizeof(buffer) ? sizes[i] : sizeof(buffer);
+                memcpy(buffer, inputs[i], size);
+            } else {
+                const char* seed = g_seed_programs[next_random() % (sizeof(g_seed_programs) / sizeof(g_seed_programs[0]))];
+                size = strlen(seed);
+                memcpy(buffer, seed, size);
+            }
+        }
+        size = mutate(buffer, size, sizeof(buffer));
+        LLVMFuzzerTestOneInput((const uint8_t*)buffer, size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%ld runs in %.2f s: %.0f executions per second.\n", runs, seconds, seconds > 0 ? runs / seconds : 0.0);
+    for (int i = 0; i < input_count; i++) {
+        free(inputs[i]);
+    }
+    free(inputs);
+    free(sizes);
+    return 0;
+}
+
+// =============Standalone Driver============== end
+#endif // RDP_FUZZ_STANDALONE
@@ -1,5 +1,6 @@
-// parser.c
+// main.c
 // Recursive Descent Parser for Control Structures and Nested Expressions
+// Command-line front end for the parser library (parser.c)
 // Course: Programming Languages and Structures
 // Code by: Md. Alamin
 // Student ID: 134
@@ -7,124 +8,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-#include <setjmp.h>  // jmp_buf, setjmp, and longjmp
-#include <unistd.h>  // dup, dup2, and close functions
+#include <unistd.h>  // write, STDOUT_FILENO and unlink
+#include <errno.h>   // EINTR from write
+#include "parser.h"
 
 // --- Configuration ---
 
-#define MAX_SYMBOLS 100
 int g_student_ltd_value = 134; // Default value for LTD (Last Three Digits of Student ID)
-// --- Global Variables for Lexer and Parser ---
-static const char *g_source_code; // Start of the source code
-static const char *g_source_ptr;  // Pointer to the current character
-
-// =============1. Lexer (Scanner) Implementation============== start
-// --- Token Definitions ---
-typedef enum {
-    TOKEN_EOF,
-    TOKEN_ERROR,
-
-    // Keywords
-    TOKEN_IF,
-    TOKEN_ELSE,
-    TOKEN_WHILE,
-
-    // Symbols
-    TOKEN_LBRACE,    // {
-    TOKEN_RBRACE,    // }
-    TOKEN_LPAREN,    // (
-    TOKEN_RPAREN,    // )
-    TOKEN_SEMICOLON, // ;
-
-    // Operators
-    TOKEN_PLUS,      // +
-    TOKEN_MINUS,     // -
-    TOKEN_MULTIPLY,  // *
-    TOKEN_DIVIDE,    // /
-
-    // Relational Operators
-    TOKEN_EQ,        // ==
-    TOKEN_NEQ,       // !=
-    TOKEN_LT,        // <
-    TOKEN_GT,        // >
-    TOKEN_LTE,       // <=
-    TOKEN_GTE,       // >=
-
-    // Literals and Identifiers
-    TOKEN_NUMBER,
-    TOKEN_IDENTIFIER,
-    TOKEN_LTD        // Special identifier "LTD"
-} TokenType;
-
-const char* token_type_to_string(TokenType type) {
-    switch (type) {
-        case TOKEN_EOF: return "EOF";
-        case TOKEN_ERROR: return "ERROR";
-        case TOKEN_IF: return "IF";
-        case TOKEN_ELSE: return "ELSE";
-        case TOKEN_WHILE: return "WHILE";
-        case TOKEN_LBRACE: return "LBRACE ('{')";
-        case TOKEN_RBRACE: return "RBRACE ('}')";
-        case TOKEN_LPAREN: return "LPAREN ('(')";
-        case TOKEN_RPAREN: return "RPAREN (')')";
-        case TOKEN_SEMICOLON: return "SEMICOLON (';')";
-        case TOKEN_PLUS: return "PLUS ('+')";
-        case TOKEN_MINUS: return "MINUS ('-')";
-        case TOKEN_MULTIPLY: return "MULTIPLY ('*')";
-        case TOKEN_DIVIDE: return "DIVIDE ('/')";
-        case TOKEN_EQ: return "EQ ('==')";
-        case TOKEN_NEQ: return "NEQ ('!=')";
-        case TOKEN_LT: return "LT ('<')";
-        case TOKEN_GT: return "GT ('>')";
-        case TOKEN_LTE: return "LTE ('<=')";
-        case TOKEN_GTE: return "GTE ('>=')";
-        case TOKEN_NUMBER: return "NUMBER";
-        case TOKEN_IDENTIFIER: return "IDENTIFIER";
-        case TOKEN_LTD: return "LTD";
-        default: return "UNKNOWN_TOKEN";
-    }
-}
-
-typedef struct {
-    TokenType type;
-    char value[100]; // Buffer for number value or identifier name
-    int line;        // Line number where the token starts
-    int col;         // Column number where the token starts
-} Token;
-
-typedef struct {
-    char name[100];
-    int value;
-} Symbol;
-
-Symbol g_symbol_table[MAX_SYMBOLS];
-int g_symbol_count = 0;
-
-// --- Global Variables for Lexer and Parser ---
-static Token g_current_token;      // The current token being processed by the parser
-static int g_current_line = 1;     // Current line number in the source
-static int g_current_col = 1;      // Current column number in the source
-static int g_start_col_for_token = 1; // Column where the current token began
-
-// --- Forward Declarations for Parser Functions ---
-static void program();
-static void block();
-static void statement();
-static void if_statement();
-static void while_statement();
-static void condition();
-static void relational_operator();
-static void expression();
-static void term();
-static void factor();
-
-// Forward declarations for evaluator functions
-static int eval_expression();
-static int eval_term();
-static int eval_factor();
-// Error handling forward declaration
-static void error_at_current_token(const char* message);
 
 // Pre-defined test cases
 const char* test_cases[] = {
@@ -142,6 +32,103 @@ const char* test_cases[] = {
     "{ else { x; } }" // else without if
 };
 
+// Programs for the value checks
+#define TEN_IDS(p) p "0; " p "1; " p "2; " p "3; " p "4; " p "5; " p "6; " p "7; " p "8; " p "9; "
+#define HUNDRED_IDS(p) TEN_IDS(p "0") TEN_IDS(p "1") TEN_IDS(p "2") TEN_IDS(p "3") TEN_IDS(p "4") \
+                       TEN_IDS(p "5") TEN_IDS(p "6") TEN_IDS(p "7") TEN_IDS(p "8") TEN_IDS(p "9")
+#define INT_MIN_VALUE (-2147483647 - 1)
+#define HEAVY_LOOP "while (a > LTD) { (a + b) * (a - b) * (a + b) * (a - b) * (a + b) * (a - b) * (a + b) * (a - b); } "
+#define HEAVY_LOOPS HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP \
+                    HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP HEAVY_LOOP
+#define SIXTEEN(x) x x x x x x x x x x x x x x x x
+// About 85 KB on 48 lines: two of them are more than a parallel parse puts in one range
+#define LARGE_PART SIXTEEN(HEAVY_LOOPS "\n") SIXTEEN(HEAVY_LOOPS "\n") SIXTEEN(HEAVY_LOOPS "\n")
+
+// Value checks: each program runs with the engine of a command-line flag (-prefilter
+// evaluates after the pre-filter, -parallel and -validate only check the program) and
+// default options, LTD 134, plus an optional -limit setting. It must end with the
+// expected status and, on success of an engine that executes the program, the expected
+// value. Without a limit, every engine other than -run must also agree with -run.
+typedef struct {
+    const char* engine;
+    const char* limit;
+    const char* source;
+    ParserStatus status;
+    int value;
+    int line, col;  // Position of the expected error where it differs from -run's (0: -run's)
+} ValueCheck;
+
+const ValueCheck value_checks[] = {
+    // Interpreter arithmetic: wraps on overflow, INT_MIN / -1 included; '/' rounds toward zero
+    {"-run", NULL, "{ 2147483647 + 1; }", PARSER_OK, INT_MIN_VALUE, 0, 0},
+    {"-run", NULL, "{ (0 - 2147483647 - 1) / (0 - 1); }", PARSER_OK, INT_MIN_VALUE, 0, 0},
+    {"-run", NULL, "{ 65536 * 65536 + (0 - 7) / 2; }", PARSER_OK, -3, 0, 0},
+    {"-run", NULL, "{ if (a == LTD) { 1; } else { LTD * 2; } }", PARSER_OK, 268, 0, 0},
+    {"-run", NULL, "{ a; x / 0; }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    {"-run", NULL, "{ while (LTD > 0) { a; } }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    // More distinct identifiers than the first symbol table held
+    {"-run", NULL, "{ " HUNDRED_IDS("v") HUNDRED_IDS("w") "v00 + w99 + 5; }", PARSER_OK, 5, 0, 0},
+    // The optimizer changes how a program runs, not what it computes
+    {"-optimize", NULL, "{ while (a > 0) { (LTD * 8) / 4 + b; } (LTD * 8) / 4 + (0 - 9) / 4; }", PARSER_OK, 266, 0, 0},
+    {"-optimize", NULL, "{ while (b < 1) { if (a > 0) { 1 / a; } (LTD + 1) * 16; } }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    {"-optimize", NULL, "{ (0 - 2147483647 - 1) / (0 - 1) + (0 - 7) * 4; }", PARSER_OK, 2147483620, 0, 0},
+    // Shared subexpressions and memoized values give the values of the tree
+    {"-dag", NULL, "{ " HUNDRED_IDS("v") HUNDRED_IDS("w") "v00 + w99 + 5; }", PARSER_OK, 5, 0, 0},
+    {"-dag", NULL, "{ (LTD - 1) * (LTD - 1) + (LTD - 1); if (a > 0) { 1 / a; } (2 - 1) * 5; }", PARSER_OK, 5, 0, 0},
+    {"-dag", NULL, "{ (a + 1) * (a + 1); (a + 1) / a; }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    // Native code agrees with the interpreter (skipped when no C compiler is found)
+    {"-native", NULL, "{ (0 - 2147483647 - 1) / (0 - 1); 2147483647 * 2; }", PARSER_OK, -2, 0, 0},
+    {"-native", NULL, "{ if (a < LTD) { (LTD - 4) / 2; } else { 1 / a; } }", PARSER_OK, 65, 0, 0},
+    {"-native", NULL, "{ 1; LTD / a; }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    {"-native", NULL, "{ while (LTD > 0) { a; } }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    {"-native", NULL, "{ " HUNDRED_IDS("v") HUNDRED_IDS("w") "v00 + w99 + 5; }", PARSER_OK, 5, 0, 0},
+    // The pipelined lexer hands the parser the tokens of the sequential one
+    {"-pipeline", NULL, "{ if (a == LTD) { 1; } else { (LTD + 1) * 2; } /* comment */ a - 1; }", PARSER_OK, -1, 0, 0},
+    {"-pipeline", NULL, "{ " LARGE_PART "LTD + 2; }", PARSER_OK, 136, 0, 0},
+    {"-pipeline", NULL, "{ while (a < 1) { b; } }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    {"-pipeline", NULL, "{ a;\n  b + ; }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    // Parallel evaluation gives the statistics, value and first error of the sequential run
+    {"-eval-threads", NULL, "{ " HEAVY_LOOPS HEAVY_LOOPS "LTD * 3; }", PARSER_OK, 402, 0, 0},
+    {"-eval-threads", NULL, "{ " HEAVY_LOOPS "(LTD + 1) / a; " HEAVY_LOOPS "LTD; }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    // Files read in a batch (-pread: without io_uring); no source stands for a missing file
+    {"-files", NULL, "{ if (a == LTD) { 1; } else { LTD - 4; } }", PARSER_OK, 130, 0, 0},
+    {"-files", NULL, "{ " LARGE_PART "LTD + 2; }", PARSER_OK, 136, 0, 0},
+    {"-files", NULL, "{ a;\n  (b; }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-files", NULL, "{ 1; LTD / a; }", PARSER_RUNTIME_ERROR, 0, 0, 0},
+    {"-files", NULL, NULL, PARSER_IO_ERROR, 0, 0, 0},
+    {"-pread", NULL, "{ " LARGE_PART "LTD + 2; }", PARSER_OK, 136, 0, 0},
+    {"-pread", NULL, "{ a;\n  (b; }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-pread", NULL, NULL, PARSER_IO_ERROR, 0, 0, 0},
+    // Limits, one status per limit
+    {"-run", "depth=2", "{ ((1)); }", PARSER_DEPTH_LIMIT, 0, 0, 0},
+    {"-run", "tokens=5", "{ 1 + 2; }", PARSER_TOKEN_LIMIT, 0, 0, 0},
+    {"-run", "bytes=3", "{ 1 + 2; }", PARSER_INPUT_LIMIT, 0, 0, 0},
+    {"-prefilter", "bytes=3", "{ 1 + 2; }", PARSER_INPUT_LIMIT, 0, 0, 0},
+    {"-run", "arena=64", "{ 1 + 2; }", PARSER_ARENA_LIMIT, 0, 0, 0},
+    {"-run", "depth=3", "{ ((1)); }", PARSER_OK, 1, 0, 0},
+    // A parallel parse splits into ranges and reports the first error of the sequential parse
+    {"-parallel", NULL, "{ " LARGE_PART LARGE_PART "LTD * 3; }", PARSER_OK, 0, 0, 0},
+    {"-parallel", NULL, "{ " LARGE_PART "a; " LARGE_PART "\n a + ; }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-parallel", NULL, "{ " LARGE_PART "(a; " LARGE_PART "b + ; }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    // The validator accepts and rejects what the parser does, at the same positions
+    {"-validate", NULL, "{ if (a <= LTD) { b; } else { a; } /* c */ while (b >= 1) { if (a == b) { 1; } } }", PARSER_OK, 0, 0, 0},
+    {"-validate", NULL, "{ while (a != b) { a = b; } }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-validate", NULL, "{ a; b >= 1; }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-validate", NULL, "{ a; @ }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-validate", NULL, "{ else { x; } }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-validate", NULL, "{ a; /* b", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-validate", NULL, "{ a; } <", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    // The pre-filter reports bracket and comment errors where the bracket or comment is
+    {"-prefilter", NULL, "{ a; ", PARSER_SYNTAX_ERROR, 0, 1, 1},
+    {"-prefilter", NULL, "{ a; } }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-prefilter", NULL, "{ a; ) }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-prefilter", NULL, "{ (a; }", PARSER_SYNTAX_ERROR, 0, 1, 7},
+    {"-prefilter", NULL, "{ a;\n  while (b < 1) { (c; }\n}", PARSER_SYNTAX_ERROR, 0, 2, 23},
+    {"-prefilter", NULL, "{ a; /* b", PARSER_SYNTAX_ERROR, 0, 1, 6},
+    {"-prefilter", NULL, "{ a; @ }", PARSER_SYNTAX_ERROR, 0, 0, 0},
+    {"-prefilter", NULL, "{ /* ( */ a; // }\n  b + 1; }", PARSER_OK, 1, 0, 0}
+};
+
 // read input from console
 char* read_from_console() {
     printf("Enter program (end with Ctrl+D on Unix/Linux or Ctrl+Z on Windows):\n");
@@ -178,560 +165,946 @@ char* read_from_console() {
     return buffer;
 }
 
-// Function to look up or add a symbol
-static int get_symbol_value(const char* name) {
-    // Look for existing symbol
-    for (int i = 0; i < g_symbol_count; i++) {
-        if (strcmp(g_symbol_table[i].name, name) == 0) {
-            return g_symbol_table[i].value;
-        }
-    }
-    
-    // Add new symbol with dummy value (0)
-    if (g_symbol_count < MAX_SYMBOLS) {
-        strcpy(g_symbol_table[g_symbol_count].name, name);
-        g_symbol_table[g_symbol_count].value = 0; // Default value
-        return g_symbol_table[g_symbol_count++].value;
-    } else {
-        error_at_current_token("Symbol table overflow");
-        return 0;
-    }
-}
-
 
 // =============3. Error Handling============== start
 
-// --- Error Handling ---
-static void error_at_current_token(const char* message) {
-    fprintf(stderr, "Syntax Error on line %d, col %d: %s\n", g_current_token.line, g_current_token.col, message);
-    fprintf(stderr, "Near token: '%s' (Type: %s)\n", g_current_token.value, token_type_to_string(g_current_token.type));
+// Prints an error the library returned, with the source line and a caret under it
+static void print_parse_error(const char* source, const ParserError* error) {
+    if (strcmp(error->kind, "Backend") == 0) {
+        fprintf(stderr, "Backend Error: %s\n", error->message); // Not about a place in the source
+        return;
+    }
+    fprintf(stderr, "%s Error on line %d, col %d: %s\n", error->kind, error->line, error->col, error->message);
+    int at_node = strcmp(error->token_type, "ERROR") == 0 && error->token[0] == '\0'; // Raised while running
+    if (strcmp(error->kind, "Runtime") != 0 && !at_node) {
+        fprintf(stderr, "Near token: '%s' (Type: %s)\n", error->token, error->token_type);
+    }
     
     // Find the beginning of the line
-    const char* line_start = g_source_ptr;
-    while (line_start > g_source_code && *(line_start-1) != '\n') {
+    const char* line_start = source + error->offset;
+    while (line_start > source && *(line_start-1) != '\n') {
         line_start--;
     }
     
     // Find the end of the line
-    const char* line_end = g_source_ptr;
+    const char* line_end = source + error->offset;
     while (*line_end != '\0' && *line_end != '\n') {
         line_end++;
     }
     
     // Print the line
-    fprintf(stderr, "Line %d: ", g_current_token.line);
+    fprintf(stderr, "Line %d: ", error->line);
     fprintf(stderr, "%.*s\n", (int)(line_end - line_start), line_start);
     
     // Print a caret pointing to the error position
-    fprintf(stderr, "%*s^\n", g_current_token.col - 1, "");
-    
-    exit(EXIT_FAILURE);
+    fprintf(stderr, "%*s^\n", error->col - 1, "");
 }
 
-// --- Lexer Implementation ---
-static Token make_token(TokenType type, const char* value_str, int line, int col) {
-    Token token;
-    token.type = type;
-    if (value_str != NULL) {
-        strncpy(token.value, value_str, sizeof(token.value) - 1);
-        token.value[sizeof(token.value) - 1] = '\0';
+// =============3. Error Handling============== end
+
+// -limit NAME=VALUE; time is in milliseconds. Returns 0 for an unknown name or bad value.
+static int parse_limit(ParserLimits* limits, const char* setting) {
+    const char* equals = strchr(setting, '=');
+    char* end;
+    if (equals == NULL || equals[1] == '\0') {
+        return 0;
+    }
+    long long value = strtoll(equals + 1, &end, 10);
+    if (*end != '\0' || value < 0) {
+        return 0;
+    }
+
+    size_t length = (size_t)(equals - setting);
+    if (length == 5 && strncmp(setting, "depth", 5) == 0) {
+        limits->max_depth = (int)value;
+    } else if (length == 6 && strncmp(setting, "tokens", 6) == 0) {
+        limits->max_tokens = (long)value;
+    } else if (length == 5 && strncmp(setting, "bytes", 5) == 0) {
+        limits->max_bytes = (size_t)value;
+    } else if (length == 4 && strncmp(setting, "time", 4) == 0) {
+        limits->max_time_ns = value * 1000000LL;
+    } else if (length == 5 && strncmp(setting, "arena", 5) == 0) {
+        limits->max_arena_bytes = (size_t)value;
     } else {
-        token.value[0] = '\0';
+        return 0;
     }
-    token.line = line;
-    token.col = col;
-    return token;
+    return 1;
 }
 
-static void skip_whitespace_and_comments() {
-    while (*g_source_ptr != '\0') {
-        if (isspace((unsigned char)*g_source_ptr)) {
-            if (*g_source_ptr == '\n') {
-                g_current_line++;
-                g_current_col = 1;
-            } else {
-                g_current_col++;
-            }
-            g_source_ptr++;
-        } 
-        // Handle C-style comments
-        else if (*g_source_ptr == '/' && *(g_source_ptr + 1) == '*') {
-            g_source_ptr += 2; // Skip /*
-            g_current_col += 2;
-            
-            while (!(*g_source_ptr == '*' && *(g_source_ptr + 1) == '/') && *g_source_ptr != '\0') {
-                if (*g_source_ptr == '\n') {
-                    g_current_line++;
-                    g_current_col = 1;
-                } else {
-                    g_current_col++;
-                }
-                g_source_ptr++;
-            }
-            
-            if (*g_source_ptr == '\0') {
-                // Unclosed comment
-                error_at_current_token("Unclosed comment detected");
-            } else {
-                g_source_ptr += 2; // Skip */
-                g_current_col += 2;
-            }
-        }
-        // Handle C++-style comments
-        else if (*g_source_ptr == '/' && *(g_source_ptr + 1) == '/') {
-            g_source_ptr += 2; // Skip //
-            g_current_col += 2;
-            
-            while (*g_source_ptr != '\n' && *g_source_ptr != '\0') {
-                g_source_ptr++;
-                g_current_col++;
-            }
+static ParserLimits g_cli_limits; // Set by -limit
+
+// Library options for the settings made on the command line or in the menu
+static void cli_options(ParserOptions* options) {
+    parser_default_options(options);
+    options->limits = g_cli_limits;
+    options->ltd_value = g_student_ltd_value;
+}
+
+// Function to read entire file into a string
+char* read_file_to_string(const char* filename) {
+    FILE *file = fopen(filename, "rb"); // Open in binary mode to correctly get length
+    if (!file) {
+        perror("Error opening file");
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *buffer = (char*)malloc(length + 1);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed for file buffer\n");
+        fclose(file);
+        return NULL;
+    }
+
+    if (fread(buffer, 1, length, file) != (size_t)length) {
+        fprintf(stderr, "Error reading file\n");
+        fclose(file);
+        free(buffer);
+        return NULL;
+    }
+    buffer[length] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+// =============5. Test Case Suite============== start
+
+// Process a single test case
+// Returns 1 if the test case passed
+static int process_test_case(const char* test_input, int test_number, int is_valid_expected) {
+    printf("\n\n------------------------------------------\n");
+    printf("TEST CASE %d: %s\n", test_number, is_valid_expected ? "VALID" : "INVALID");
+    printf("------------------------------------------\n");
+    printf("Input: %s\n\n", test_input);
+    
+    ParserOptions options;
+    ParserResult result;
+    cli_options(&options);
+    options.trace = stdout;
+    
+    // Errors come back as values, so nothing is printed to stderr
+    int parsed = parser_process(test_input, &options, &result) == PARSER_OK;
+    int success = 1;
+    
+    if (is_valid_expected) {
+        if (parsed) {
+            printf("✓ Program parsed successfully!\n");
+        } else {
+            success = 0;
+            printf("✗ Parsing failed unexpectedly!\n");
         }
-        else {
-            break; // Not whitespace or comment
+    } else {
+        // For invalid cases, we expect an error
+        if (parsed) {
+            printf("✗ Expected parsing to fail, but it succeeded!\n");
+            success = 0;
+        } else {
+            printf("✓ Parsing failed as expected for invalid input.\n");
         }
     }
+    parser_free_result(&result);
+    
+    printf("\nTest result: %s\n", success ? "PASS" : "FAIL");
+    return success;
 }
 
-static Token lexer_get_next_token_internal() {
-    skip_whitespace_and_comments();
-    g_start_col_for_token = g_current_col; // Record column at start of token
+static const char* status_name(ParserStatus status) {
+    static const char* const names[] = {"ok", "syntax error", "runtime error", "out of memory", "backend error",
+                                        "depth limit", "token limit", "input limit", "time limit", "arena limit",
+                                        "I/O error"};
+    return (unsigned)status < sizeof(names) / sizeof(names[0]) ? names[status] : "unknown status";
+}
 
-    if (*g_source_ptr == '\0') {
-        return make_token(TOKEN_EOF, "EOF", g_current_line, g_start_col_for_token);
+// Writes source to a temporary file and processes it with parser_process_files(). Without
+// a source, the file is removed before it is read.
+static void process_as_file(const char* source, const ParserOptions* options, ParserResult* result) {
+    const char* directory = getenv("TMPDIR");
+    char path[256];
+    if (directory == NULL || *directory == '\0') directory = "/tmp";
+    snprintf(path, sizeof(path), "%s/rdp-check-XXXXXX", directory);
+
+    int fd = mkstemp(path);
+    FILE* out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (out) {
+        if (source) fputs(source, out);
+        fclose(out);
+    } else if (fd >= 0) {
+        close(fd);
     }
+    if (fd >= 0 && source == NULL) unlink(path);
 
-    char current_char = *g_source_ptr;
-    char next_char = *(g_source_ptr + 1);
+    const char* paths[1] = {path};
+    parser_process_files(paths, 1, options, result, NULL);
+    if (fd >= 0 && source) unlink(path);
+}
 
-    // Multi-character operators (==, !=, <=, >=)
-    if (current_char == '=' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_EQ, "==", g_current_line, g_start_col_for_token); }
-    if (current_char == '!' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_NEQ, "!=", g_current_line, g_start_col_for_token); }
-    if (current_char == '<' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_LTE, "<=", g_current_line, g_start_col_for_token); }
-    if (current_char == '>' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_GTE, ">=", g_current_line, g_start_col_for_token); }
+// Runs source with the engine of a command-line flag, as described for value_checks.
+// Returns 1 if the engine executed the program.
+static int run_engine(const char* engine, const char* limit, const char* source, ParserResult* result) {
+    ParserOptions options;
+    parser_default_options(&options);
+    options.mode = PARSER_EVALUATE;
+    if (strcmp(engine, "-parallel") == 0) {
+        options.mode = PARSER_PARSE;
+        options.threads = 4;
+    } else if (strcmp(engine, "-validate") == 0) {
+        options.mode = PARSER_VALIDATE;
+    }
+    options.prefilter = strcmp(engine, "-prefilter") == 0;
+    options.optimize = strcmp(engine, "-optimize") == 0;
+    options.hash_cons = strcmp(engine, "-dag") == 0;
+    options.pipeline = strcmp(engine, "-pipeline") == 0;
+    options.eval_threads = strcmp(engine, "-eval-threads") == 0 ? 4 : 0;
+    if (limit) {
+        parse_limit(&options.limits, limit);
+    }
+    if (strcmp(engine, "-files") == 0 || strcmp(engine, "-pread") == 0) {
+        options.use_pread = strcmp(engine, "-pread") == 0;
+        options.batch_threads = 2;
+        process_as_file(source, &options, result);
+        return 1;
+    }
+    if (strcmp(engine, "-native") != 0) {
+        parser_process(source, &options, result);
+        return options.mode == PARSER_EVALUATE;
+    }
+    ParserNative program;
+    if (parser_compile_native(source, &options, &program, result) == PARSER_OK) {
+        parser_run_native(&program, result);
+        parser_free_native(&program);
+    }
+    return 1;
+}
 
-    // Single-character symbols and operators
-    char single_char_val[2] = {current_char, '\0'};
-    g_source_ptr++; g_current_col++;
-    switch (current_char) {
-        case '{': return make_token(TOKEN_LBRACE, single_char_val, g_current_line, g_start_col_for_token);
-        case '}': return make_token(TOKEN_RBRACE, single_char_val, g_current_line, g_start_col_for_token);
-        case '(': return make_token(TOKEN_LPAREN, single_char_val, g_current_line, g_start_col_for_token);
-        case ')': return make_token(TOKEN_RPAREN, single_char_val, g_current_line, g_start_col_for_token);
-        case ';': return make_token(TOKEN_SEMICOLON, single_char_val, g_current_line, g_start_col_for_token);
-        case '+': return make_token(TOKEN_PLUS, single_char_val, g_current_line, g_start_col_for_token);
-        case '-': return make_token(TOKEN_MINUS, single_char_val, g_current_line, g_start_col_for_token);
-        case '*': return make_token(TOKEN_MULTIPLY, single_char_val, g_current_line, g_start_col_for_token);
-        case '/': return make_token(TOKEN_DIVIDE, single_char_val, g_current_line, g_start_col_for_token);
-        case '<': return make_token(TOKEN_LT, single_char_val, g_current_line, g_start_col_for_token);
-        case '>': return make_token(TOKEN_GT, single_char_val, g_current_line, g_start_col_for_token);
+// Whether -native checks can run: the C compiler builds a trivial program
+static int native_available(void) {
+    static int available = -1;
+    if (available < 0) {
+        ParserResult result;
+        run_engine("-native", NULL, "{ 1; }", &result);
+        available = result.status == PARSER_OK;
+        parser_free_result(&result);
     }
-    // Backtrack if not a recognized single character
-    g_source_ptr--; g_current_col--;
+    return available;
+}
 
-    // Numbers: <digit> { <digit> }
-    if (isdigit((unsigned char)current_char)) {
-        char num_buffer[100];
-        int i = 0;
-        num_buffer[i++] = current_char;
-        g_source_ptr++; g_current_col++;
-        while (*g_source_ptr != '\0' && isdigit((unsigned char)*g_source_ptr)) {
-            if (i < sizeof(num_buffer) - 1) num_buffer[i++] = *g_source_ptr;
-            g_source_ptr++; g_current_col++;
-        }
-        num_buffer[i] = '\0';
-        return make_token(TOKEN_NUMBER, num_buffer, g_current_line, g_start_col_for_token);
+static void describe_outcome(ParserStatus status, int executed, int value, int line, int col, char* out,
+                             size_t size) {
+    if (status == PARSER_OK) {
+        snprintf(out, size, executed ? "ok %d" : "ok", value);
+    } else if (line > 0) {
+        snprintf(out, size, "%s at %d:%d", status_name(status), line, col);
+    } else {
+        snprintf(out, size, "%s", status_name(status));
     }
+}
 
-    // Identifiers and Keywords: <letter> { <letter> | <digit> } (allow underscore)
-    if (isalpha((unsigned char)current_char) || current_char == '_') {
-        char id_buffer[100];
-        int i = 0;
-        id_buffer[i++] = current_char;
-        g_source_ptr++; g_current_col++;
-        while (*g_source_ptr != '\0' && (isalnum((unsigned char)*g_source_ptr) || *g_source_ptr == '_')) {
-            if (i < sizeof(id_buffer) - 1) id_buffer[i++] = *g_source_ptr;
-            g_source_ptr++; g_current_col++;
+// Runs one value check, describing what it expected and what happened.
+// Returns 1 if it passed, 0 if it failed and -1 if it was skipped.
+static int run_value_check(const ValueCheck* check, char* expected, size_t expected_size, char* verdict, size_t size) {
+    if (strcmp(check->engine, "-native") == 0 && !native_available()) {
+        describe_outcome(check->status, 1, check->value, check->line, check->col, expected, expected_size);
+        snprintf(verdict, size, "skipped (no working C compiler)");
+        return -1;
+    }
+
+    ParserResult result;
+    int executed = run_engine(check->engine, check->limit, check->source, &result);
+    describe_outcome(check->status, executed, check->value, check->line, check->col, expected, expected_size);
+    describe_outcome(result.status, executed, result.value, result.error.line, result.error.col, verdict, size);
+    int pass = result.status == check->status &&
+               (result.status != PARSER_OK || !executed || result.value == check->value) &&
+               (check->line == 0 || (result.error.line == check->line && result.error.col == check->col));
+
+    if (pass && check->limit == NULL && check->source && strcmp(check->engine, "-run") != 0) {
+        ParserResult reference;
+        run_engine("-run", NULL, check->source, &reference);
+        int native = strcmp(check->engine, "-native") == 0;
+        if (reference.status != result.status ||
+            (check->line == 0 &&
+             (reference.error.line != result.error.line || reference.error.col != result.error.col)) ||
+            (executed && result.status == PARSER_OK &&
+             (reference.value != result.value || reference.iterations != result.iterations)) ||
+            (executed && !native && reference.statements != result.statements)) {
+            size_t length = strlen(verdict);
+            snprintf(verdict + length, size - length, ", but -run gives ");
+            length = strlen(verdict);
+            describe_outcome(reference.status, executed, reference.value, reference.error.line,
+                             reference.error.col, verdict + length, size - length);
+            pass = 0;
         }
-        id_buffer[i] = '\0';
+        parser_free_result(&reference);
+    }
+    if (pass && strcmp(check->engine, "-parallel") == 0 && result.ranges < 2) {
+        size_t length = strlen(verdict);
+        snprintf(verdict + length, size - length, ", but not split into ranges");
+        pass = 0;
+    }
+    if (pass && strcmp(check->engine, "-pipeline") == 0 && !result.pipelined) {
+        size_t length = strlen(verdict);
+        snprintf(verdict + length, size - length, ", but the lexer did not run on its own thread");
+        pass = 0;
+    }
+    if (pass && strcmp(check->engine, "-eval-threads") == 0 && result.eval_tasks < 2) {
+        size_t length = strlen(verdict);
+        snprintf(verdict + length, size - length, ", but not split into tasks");
+        pass = 0;
+    }
+    parser_free_result(&result);
+    return pass;
+}
+
+// Runs the value checks with one line each. Returns the number that failed.
+static int process_value_checks(void) {
+    const int check_count = sizeof(value_checks) / sizeof(value_checks[0]);
+    int failed = 0;
+    printf("\n\n------------------------------------------\n");
+    printf("VALUE CHECKS\n");
+    printf("------------------------------------------\n");
+    for (int i = 0; i < check_count; i++) {
+        const ValueCheck* check = &value_checks[i];
+        char expected[64], verdict[160];
+        int pass = run_value_check(check, expected, sizeof(expected), verdict, sizeof(verdict));
+        failed += pass == 0;
+        const char* source = check->source ? check->source : "(missing file)";
+        int shown = (int)strcspn(source, "\n"); // The first line, up to 50 characters
+        if (shown > 50) shown = 50;
+        printf("%s CHECK %d: %s%s%s %.*s%s\n", pass > 0 ? "✓" : pass < 0 ? "-" : "✗", i + 1, check->engine,
+               check->limit ? " -limit " : "", check->limit ? check->limit : "", shown, source,
+               source[shown] ? "..." : "");
+        printf("    expected %s, got %s\n", expected, verdict);
+    }
+    printf("\nValue checks: %d of %d failed.\n", failed, check_count);
+    return failed;
+}
 
-        // Check for keywords
-        if (strcmp(id_buffer, "if") == 0) return make_token(TOKEN_IF, id_buffer, g_current_line, g_start_col_for_token);
-        if (strcmp(id_buffer, "else") == 0) return make_token(TOKEN_ELSE, id_buffer, g_current_line, g_start_col_for_token);
-        if (strcmp(id_buffer, "while") == 0) return make_token(TOKEN_WHILE, id_buffer, g_current_line, g_start_col_for_token);
-        if (strcmp(id_buffer, "LTD") == 0) return make_token(TOKEN_LTD, id_buffer, g_current_line, g_start_col_for_token);
+// =============5. Test Case Suite============== end
 
-        return make_token(TOKEN_IDENTIFIER, id_buffer, g_current_line, g_start_col_for_token);
+// --- Text Results ---
+
+static void print_optimization_report(const ParserResult* result) {
+    int reduced_in_loops = 0;
+    printf("\nLoop optimization report:\n");
+    if (result->loop_count == 0) {
+        printf("  No while loops.\n");
+    }
+    for (int i = 0; i < result->loop_count; i++) {
+        const ParserLoopReport* loop = &result->loops[i];
+        printf("  while at line %d, col %d: %ld -> %ld operations per iteration (%d hoisted, %d strength-reduced)\n",
+               loop->line, loop->col, loop->ops_before, loop->ops_after, loop->hoisted, loop->reduced);
+        reduced_in_loops += loop->reduced;
     }
+    printf("  Strength-reduced outside loops: %d\n", result->reduced - reduced_in_loops);
+    printf("  Temporaries: %d\n", result->temporaries);
+}
 
-    // If no rule matches, it's an unrecognized character
-    char error_char_val[2] = {current_char, '\0'};
-    g_source_ptr++; g_current_col++; // Consume the erroneous character to avoid infinite loop
-    Token err_token = make_token(TOKEN_ERROR, error_char_val, g_current_line, g_start_col_for_token);
-    // Error will be reported by advance()
-    return err_token;
+// Prints what each phase that ran found, in the order the phases ran
+static void print_results(const ParserOptions* options, const ParserResult* result) {
+    int prefilter_failed = result->status != PARSER_OK && result->parse_ns < 0;
+    int parsed = result->status == PARSER_OK || result->status == PARSER_RUNTIME_ERROR;
+
+    if (result->prefilter_ns >= 0 && !prefilter_failed) {
+        printf("\nPre-filter passed (%lu structural characters).\n", (unsigned long)result->structural);
+    }
+    if (result->parse_ns < 0) {
+        return;
+    }
+    if (options->mode == PARSER_VALIDATE) {
+        printf("\nValidating %lu bytes...\n", (unsigned long)result->bytes);
+    } else if (options->threads > 0) {
+        printf("\nParsing %lu bytes on up to %d threads...\n", (unsigned long)result->bytes, options->threads);
+        if (parsed) {
+            printf("Parsed %d range(s) of top-level statements.\n", result->ranges);
+        }
+    } else {
+        printf("\nBuilding the syntax tree of %lu bytes...\n", (unsigned long)result->bytes);
+        if (parsed) {
+            printf("Syntax tree: %lu nodes in %lu bytes.\n", (unsigned long)result->nodes, (unsigned long)result->arena_bytes);
+        }
+        if (result->pipelined) {
+            printf("Pipelined lexer: the lexer waited %ld times (%.3f ms) on a full ring, the parser %ld times (%.3f ms) on an empty one.\n",
+                   result->lexer_stalls, result->lexer_stall_ns / 1e6, result->parser_stalls, result->parser_stall_ns / 1e6);
+        }
+        if (parsed && options->hash_cons) {
+            printf("Expression DAG: %lu of %lu expression nodes are unique (%.2fx deduplication), %lu bytes saved.\n",
+                   (unsigned long)result->unique_expressions, (unsigned long)result->expressions,
+                   result->unique_expressions ? (double)result->expressions / (double)result->unique_expressions : 1.0,
+                   (unsigned long)result->saved_bytes);
+        }
+        if (result->optimize_ns >= 0) {
+            print_optimization_report(result);
+        }
+        if (result->run_ns >= 0 && result->status == PARSER_OK) {
+            printf("\nExecuted %ld statements, %ld operations, %ld loop iterations. Last value: %d\n",
+                   result->statements, result->operations, result->iterations, result->value);
+            if (options->hash_cons) {
+                printf("Memoized evaluations: %ld\n", result->memo_hits);
+            }
+            if (options->eval_threads > 1 && !options->hash_cons && !options->profile) {
+                printf("Evaluated on up to %d threads: %ld tasks, %d statements had to wait for earlier ones.\n",
+                       options->eval_threads, result->eval_tasks, result->barriers);
+            }
+        }
+        if (result->profile_count > 0) {
+            // Also after a runtime error, which is where a runaway loop ends
+            printf("\nProfile (if detail: then/else taken):\n");
+            parser_write_profile(result, stdout);
+        }
+    }
 }
 
-// =============1. Lexer (Scanner) Implementation============== end
+// =============12. Structured Output============== start
+// Machine-readable records for -format jsonl|binary. Records are built in one large
+// buffer that is handed to the kernel with a single write() per flush, and nothing
+// else is written to standard output in these modes.
+//
+// JSON Lines: one object per line, {"record":"<type>","<field>":<value>,...}. Strings
+// keep valid UTF-8 as it is; a byte that is not part of a valid sequence becomes U+FFFD.
+// Binary: the header "RDPB" 0x01, then per record a little-endian u16 payload length
+// followed by the payload: a u8 record type and its fields. A field is a u8 id, then
+// an i64 (little-endian) for numbers, or a u16 length and the bytes for strings;
+// string ids have the high bit (RECORD_STRING_FIELD) set.
+
+#define RECORD_BUFFER_SIZE (64 * 1024)
+#define RECORD_MAX_BYTES 4096   // Room reserved for one record
+#define RECORD_MAX_STRING 512   // Longer strings are cut (after escaping, for JSON)
+#define RECORD_STRING_FIELD 0x80
+
+typedef enum { OUTPUT_TEXT, OUTPUT_JSONL, OUTPUT_BINARY } OutputFormat;
+
+typedef enum { RECORD_PHASE, RECORD_LOOP, RECORD_ERROR, RECORD_TEST, RECORD_RESULT, RECORD_FILE,
+               RECORD_PROFILE } RecordType;
+
+static const char* const g_record_names[] = {"phase", "loop", "error", "test", "result", "file", "profile"};
+
+// Numeric fields, then string fields; the binary ids are the enum values
+typedef enum {
+    FIELD_NS, FIELD_BYTES, FIELD_TOKENS, FIELD_NODES, FIELD_ARENA_BYTES, FIELD_STRUCTURAL,
+    FIELD_RANGES, FIELD_LOOPS, FIELD_HOISTED, FIELD_REDUCED, FIELD_TEMPORARIES, FIELD_OPS_BEFORE,
+    FIELD_OPS_AFTER, FIELD_STATEMENTS, FIELD_OPERATIONS, FIELD_ITERATIONS, FIELD_VALUE, FIELD_LINE,
+    FIELD_COL, FIELD_TEST, FIELD_TESTS, FIELD_PASSED, FIELD_EXPRESSIONS, FIELD_UNIQUE,
+    FIELD_SAVED_BYTES, FIELD_MEMO_HITS, FIELD_LEXER_STALLS, FIELD_LEXER_STALL_NS, FIELD_PARSER_STALLS,
+    FIELD_PARSER_STALL_NS, FIELD_FILES, FIELD_WORKERS, FIELD_INDEX, FIELD_PARENT, FIELD_COUNT, FIELD_THEN,
+    FIELD_ELSE, FIELD_SELF_NS, FIELD_TASKS, FIELD_BARRIERS,
+    FIELD_PHASE = RECORD_STRING_FIELD, FIELD_VERDICT, FIELD_EXPECTED, FIELD_KIND, FIELD_MESSAGE,
+    FIELD_TOKEN_TYPE, FIELD_TOKEN, FIELD_PATH, FIELD_READER
+} RecordField;
+
+static const char* const g_number_field_names[] = {
+    "ns", "bytes", "tokens", "nodes", "arena_bytes", "structural",
+    "ranges", "loops", "hoisted", "reduced", "temporaries", "ops_before",
+    "ops_after", "statements", "operations", "iterations", "value", "line",
+    "col", "test", "tests", "passed", "expressions", "unique",
+    "saved_bytes", "memo_hits", "lexer_stalls", "lexer_stall_ns", "parser_stalls",
+    "parser_stall_ns", "files", "workers", "index", "parent", "count", "then",
+    "else", "self_ns", "tasks", "barriers"
+};
+static const char* const g_string_field_names[] = {
+    "phase", "verdict", "expected", "kind", "message", "token_type", "token", "path", "reader"
+};
 
-// --- Parser Helper Functions ---
-// Consumes the current token and gets the next one from the lexer.
-static void advance() {
-    g_current_token = lexer_get_next_token_internal();
-    if (g_current_token.type == TOKEN_ERROR) {
-        char error_msg[150];
-        sprintf(error_msg, "Lexical error: Unrecognized character '%s'", g_current_token.value);
-        error_at_current_token(error_msg); // This will exit
+typedef struct {
+    OutputFormat format;
+    int fd;
+    char *data;          // RECORD_BUFFER_SIZE bytes
+    size_t length;       // Bytes waiting for the next flush
+    size_t record_start; // Offset of the record being built
+} RecordWriter;
+
+static void record_flush(RecordWriter* w) {
+    size_t written = 0;
+    while (written < w->length) {
+        ssize_t n = write(w->fd, w->data + written, w->length - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // Nowhere to report it; the records are dropped
+        written += (size_t)n;
     }
+    w->length = 0;
+}
+
+static void record_open(RecordWriter* w, OutputFormat format, int fd) {
+    w->format = format;
+    w->fd = fd;
+    w->length = 0;
+    w->record_start = 0;
+    w->data = (char*)malloc(RECORD_BUFFER_SIZE);
+    if (!w->data) {
+        fprintf(stderr, "Memory allocation failed for the output buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    if (format == OUTPUT_BINARY) {
+        memcpy(w->data, "RDPB\x01", 5);
+        w->length = 5;
+    }
+}
+
+static void record_close(RecordWriter* w) {
+    record_flush(w);
+    free(w->data);
+    w->data = NULL;
+}
+
+static void record_put(RecordWriter* w, const void* bytes, size_t length) {
+    memcpy(w->data + w->length, bytes, length);
+    w->length += length;
 }
 
-// Checks if the current token matches the expected type.
-// If yes, consumes it (advances). If no, reports an error.
-static void eat(TokenType expected_type, const char* error_message) {
-    if (g_current_token.type == expected_type) {
-        advance();
+static void record_begin(RecordWriter* w, RecordType type) {
+    if (w->length + RECORD_MAX_BYTES > RECORD_BUFFER_SIZE) {
+        record_flush(w);
+    }
+    w->record_start = w->length;
+    if (w->format == OUTPUT_BINARY) {
+        unsigned char header[3] = {0, 0, (unsigned char)type}; // Length is patched by record_end()
+        record_put(w, header, sizeof(header));
     } else {
-        char full_error_message[256];
-        sprintf(full_error_message, "%s. Expected %s, but got %s ('%s').",
-                error_message,
-                token_type_to_string(expected_type),
-                token_type_to_string(g_current_token.type),
-                g_current_token.value);
-        error_at_current_token(full_error_message);
+        w->length += (size_t)sprintf(w->data + w->length, "{\"record\":\"%s\"", g_record_names[type]);
     }
 }
-// =============3. Error Handling============== end
 
-// =============2. Recursive Descent Parser============== start
-// --- Recursive Descent Parser Functions ---
-// <program> -> <block>
-static void program() {
-    printf("Parsing <program>...\n");
-    block();
-    if (g_current_token.type != TOKEN_EOF) {
-        error_at_current_token("Expected end of input (EOF) after program block, but found more tokens.");
-    }
-    printf("Finished parsing <program>.\n");
-}
-
-// <block> -> "{" { <statement> } "}"
-static void block() {
-    printf("Parsing <block>...\n");
-    eat(TOKEN_LBRACE, "Expected '{' to start a block");
-    while (g_current_token.type != TOKEN_RBRACE && g_current_token.type != TOKEN_EOF) {
-        // Check if the current token can start a statement
-        TokenType tt = g_current_token.type;
-        if (tt == TOKEN_IF || tt == TOKEN_WHILE || // Keywords for statements
-            tt == TOKEN_LPAREN ||                   // Start of ( <expression> ) ;
-            tt == TOKEN_IDENTIFIER || tt == TOKEN_NUMBER || tt == TOKEN_LTD) { // Start of <expression> ;
-            statement();
-        } else {
-            error_at_current_token("Invalid token inside block. Expected a statement or '}'.");
-            break;
+static void record_int(RecordWriter* w, RecordField field, long long value) {
+    if (w->format == OUTPUT_BINARY) {
+        unsigned char bytes[9];
+        bytes[0] = (unsigned char)field;
+        for (int i = 0; i < 8; i++) {
+            bytes[1 + i] = (unsigned char)((unsigned long long)value >> (8 * i));
         }
+        record_put(w, bytes, sizeof(bytes));
+    } else {
+        w->length += (size_t)sprintf(w->data + w->length, ",\"%s\":%lld", g_number_field_names[field], value);
     }
-    eat(TOKEN_RBRACE, "Expected '}' to end a block");
-    printf("Finished parsing <block>.\n");
 }
 
-// <statement> -> <if-statement> | <while-statement> | <expression> ";"
-static void statement() {
-    printf("Parsing <statement> (current token: %s)...\n", token_type_to_string(g_current_token.type));
-    if (g_current_token.type == TOKEN_IF) {
-        if_statement();
-    } else if (g_current_token.type == TOKEN_WHILE) {
-        while_statement();
-    } else if (g_current_token.type == TOKEN_LPAREN ||
-               g_current_token.type == TOKEN_IDENTIFIER ||
-               g_current_token.type == TOKEN_NUMBER ||
-               g_current_token.type == TOKEN_LTD) {
-        expression();
-        eat(TOKEN_SEMICOLON, "Expected ';' after expression statement");
+// Length of the well-formed UTF-8 sequence of 2 to 4 bytes at p (at most length bytes
+// long), or 0 if there is none: overlong forms, surrogates and code points above
+// U+10FFFF are not well-formed.
+static size_t utf8_sequence_length(const unsigned char* p, size_t length) {
+    size_t size;
+    unsigned min_second = 0x80, max_second = 0xbf;
+    if (p[0] >= 0xc2 && p[0] <= 0xdf) {
+        size = 2;
+    } else if (p[0] >= 0xe0 && p[0] <= 0xef) {
+        size = 3;
+        if (p[0] == 0xe0) min_second = 0xa0;      // Overlong
+        else if (p[0] == 0xed) max_second = 0x9f; // Surrogates
+    } else if (p[0] >= 0xf0 && p[0] <= 0xf4) {
+        size = 4;
+        if (p[0] == 0xf0) min_second = 0x90;      // Overlong
+        else if (p[0] == 0xf4) max_second = 0x8f; // Above U+10FFFF
     } else {
-        error_at_current_token("Invalid start of a statement. Expected 'if', 'while', or an expression.");
-    }
-    printf("Finished parsing <statement>.\n");
-}
-
-// <if-statement> -> "if" "(" <condition> ")" <block> [ "else" <block> ]
-static void if_statement() {
-    printf("Parsing <if-statement>...\n");
-    eat(TOKEN_IF, "Expected 'if' keyword");
-    eat(TOKEN_LPAREN, "Expected '(' after 'if'");
-    condition();
-    eat(TOKEN_RPAREN, "Expected ')' after if-condition");
-    block();
-    if (g_current_token.type == TOKEN_ELSE) {
-        eat(TOKEN_ELSE, "Expected 'else' keyword");
-        block();
-    }
-    printf("Finished parsing <if-statement>.\n");
-}
-
-// <while-statement> -> "while" "(" <condition> ")" <block>
-static void while_statement() {
-    printf("Parsing <while-statement>...\n");
-    eat(TOKEN_WHILE, "Expected 'while' keyword");
-    eat(TOKEN_LPAREN, "Expected '(' after 'while'");
-    condition();
-    eat(TOKEN_RPAREN, "Expected ')' after while-condition");
-    block();
-    printf("Finished parsing <while-statement>.\n");
-}
-
-// <condition> -> <expression> <relational-operator> <expression>
-static void condition() {
-    printf("Parsing <condition>...\n");
-    expression();
-    relational_operator();
-    expression();
-    printf("Finished parsing <condition>.\n");
-}
-
-// <relational-operator> -> "==" | "!=" | "<" | ">" | "<=" | ">="
-static void relational_operator() {
-    printf("Parsing <relational-operator> (current token: %s)...\n", g_current_token.value);
-    switch (g_current_token.type) {
-        case TOKEN_EQ:
-        case TOKEN_NEQ:
-        case TOKEN_LT:
-        case TOKEN_GT:
-        case TOKEN_LTE:
-        case TOKEN_GTE:
-            printf("Recognized relational operator: %s\n", g_current_token.value);
-            advance(); // Consume the operator
-            break;
-        default:
-            error_at_current_token("Expected a relational operator (e.g., ==, <, >=)");
-    }
-    printf("Finished parsing <relational-operator>.\n");
-}
-
-// <expression> -> <term> { ("+" | "-") <term> }
-static void expression() {
-    printf("Parsing <expression>...\n");
-    term();
-    while (g_current_token.type == TOKEN_PLUS || g_current_token.type == TOKEN_MINUS) {
-        printf("Recognized operator in expression: %s\n", g_current_token.value);
-        advance(); // Consume '+' or '-'
-        term();
-    }
-    printf("Finished parsing <expression>.\n");
-}
-
-// <term> -> <factor> { ("*" | "/") <factor> }
-static void term() {
-    printf("Parsing <term>...\n");
-    factor();
-    while (g_current_token.type == TOKEN_MULTIPLY || g_current_token.type == TOKEN_DIVIDE) {
-        printf("Recognized operator in term: %s\n", g_current_token.value);
-        advance(); // Consume '*' or '/'
-        factor();
-    }
-    printf("Finished parsing <term>.\n");
-}
-
-// <factor> -> <number> | <identifier> | "LTD" | "(" <expression> ")"
-static void factor() {
-    printf("Parsing <factor> (current token type: %s, value: '%s')...\n", token_type_to_string(g_current_token.type), g_current_token.value);
-    if (g_current_token.type == TOKEN_NUMBER) {
-        printf("Recognized number: %s\n", g_current_token.value);
-        eat(TOKEN_NUMBER, "Error processing number in factor."); // eat already advances
-    } else if (g_current_token.type == TOKEN_IDENTIFIER) {
-        printf("Recognized identifier: %s\n", g_current_token.value);
-        eat(TOKEN_IDENTIFIER, "Error processing identifier in factor.");
-    } else if (g_current_token.type == TOKEN_LTD) {
-        printf("Recognized LTD, substituting with value: %d\n", g_student_ltd_value);
-        eat(TOKEN_LTD, "Error processing LTD in factor.");
-    } else if (g_current_token.type == TOKEN_LPAREN) {
-        eat(TOKEN_LPAREN, "Expected '(' for sub-expression in factor");
-        expression();
-        eat(TOKEN_RPAREN, "Expected ')' after sub-expression in factor");
-    } else {
-        char error_msg[200];
-        sprintf(error_msg, "Invalid factor. Expected number, identifier, LTD, or '('. Got token type %s ('%s')",
-                token_type_to_string(g_current_token.type), g_current_token.value);
-        error_at_current_token(error_msg);
+        return 0;
+    }
+    if (size > length || p[1] < min_second || p[1] > max_second) {
+        return 0;
     }
-    printf("Finished parsing <factor>.\n");
+    for (size_t i = 2; i < size; i++) {
+        if ((p[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return size;
 }
 
-// =============2. Recursive Descent Parser============== end
-
-
-// =============4. Expression Evaluation============== start
+static void record_string(RecordWriter* w, RecordField field, const char* value) {
+    size_t length = strlen(value);
+    if (w->format == OUTPUT_BINARY) {
+        if (length > RECORD_MAX_STRING) length = RECORD_MAX_STRING;
+        unsigned char header[3] = {(unsigned char)field, (unsigned char)length, (unsigned char)(length >> 8)};
+        record_put(w, header, sizeof(header));
+        record_put(w, value, length);
+        return;
+    }
 
-// Example implementation for expression evaluation
-static int eval_term() {
-    int result = eval_factor();
-    
-    while (g_current_token.type == TOKEN_MULTIPLY || g_current_token.type == TOKEN_DIVIDE) {
-        TokenType op = g_current_token.type;
-        advance(); // Consume '*' or '/'
-        int factor_value = eval_factor();
-        
-        if (op == TOKEN_MULTIPLY) {
-            result *= factor_value;
-        } else { // DIVIDE
-            if (factor_value == 0) {
-                error_at_current_token("Division by zero");
+    w->length += (size_t)sprintf(w->data + w->length, ",\"%s\":\"", g_string_field_names[field - RECORD_STRING_FIELD]);
+    size_t limit = w->length + RECORD_MAX_STRING;
+    for (size_t i = 0; i < length && w->length + 6 <= limit; i++) {
+        unsigned char c = (unsigned char)value[i];
+        if (c == '"' || c == '\\') {
+            w->data[w->length++] = '\\';
+            w->data[w->length++] = (char)c;
+        } else if (c < 0x20 || c == 0x7f) {
+            w->length += (size_t)sprintf(w->data + w->length, "\\u%04x", c);
+        } else if (c > 0x7f) {
+            size_t size = utf8_sequence_length((const unsigned char*)value + i, length - i);
+            if (size == 0) {
+                w->length += (size_t)sprintf(w->data + w->length, "\\ufffd"); // Keeps the line valid UTF-8
+            } else {
+                memcpy(w->data + w->length, value + i, size);
+                w->length += size;
+                i += size - 1;
             }
-            result /= factor_value;
+        } else {
+            w->data[w->length++] = (char)c;
         }
     }
-    
-    return result;
+    w->data[w->length++] = '"';
 }
 
-static int eval_expression() {
-    int result = eval_term();
-    
-    while (g_current_token.type == TOKEN_PLUS || g_current_token.type == TOKEN_MINUS) {
-        TokenType op = g_current_token.type;
-        advance(); // Consume '+' or '-'
-        int term_value = eval_term();
-        
-        if (op == TOKEN_PLUS) {
-            result += term_value;
-        } else { // MINUS
-            result -= term_value;
-        }
+static void record_end(RecordWriter* w) {
+    if (w->format == OUTPUT_BINARY) {
+        size_t payload = w->length - w->record_start - 2;
+        w->data[w->record_start] = (char)(payload & 0xff);
+        w->data[w->record_start + 1] = (char)(payload >> 8);
+    } else {
+        record_put(w, "}\n", 2);
     }
-    
-    return result;
 }
 
-static int eval_factor() {
-    int result = 0;
-    
-    if (g_current_token.type == TOKEN_NUMBER) {
-        result = atoi(g_current_token.value);
-        eat(TOKEN_NUMBER, "Error processing number in factor evaluation");
-    } else if (g_current_token.type == TOKEN_IDENTIFIER) {
-        result = get_symbol_value(g_current_token.value);
-        eat(TOKEN_IDENTIFIER, "Error processing identifier in factor evaluation");
-    } else if (g_current_token.type == TOKEN_LTD) {
-        result = g_student_ltd_value;
-        eat(TOKEN_LTD, "Error processing LTD in factor evaluation");
-    } else if (g_current_token.type == TOKEN_LPAREN) {
-        eat(TOKEN_LPAREN, "Expected '(' for sub-expression in factor evaluation");
-        result = eval_expression();
-        eat(TOKEN_RPAREN, "Expected ')' after sub-expression in factor evaluation");
-    } else {
-        error_at_current_token("Invalid factor in evaluation");
+static void record_parse_error(RecordWriter* w, const ParserError* error) {
+    record_begin(w, RECORD_ERROR);
+    record_string(w, FIELD_KIND, error->kind);
+    record_string(w, FIELD_MESSAGE, error->message);
+    if (strcmp(error->kind, "Backend") == 0) {
+        record_end(w);
+        return;
     }
-    
-    return result;
+    record_int(w, FIELD_LINE, error->line);
+    record_int(w, FIELD_COL, error->col);
+    if (strcmp(error->kind, "Runtime") != 0 && !(strcmp(error->token_type, "ERROR") == 0 && error->token[0] == '\0')) {
+        record_string(w, FIELD_TOKEN_TYPE, error->token_type);
+        record_string(w, FIELD_TOKEN, error->token);
+    }
+    record_end(w);
 }
 
-// =============4. Expression Evaluation============== end
+// Starts a phase record
+static void record_phase(RecordWriter* w, const char* phase, long long ns) {
+    record_begin(w, RECORD_PHASE);
+    record_string(w, FIELD_PHASE, phase);
+    record_int(w, FIELD_NS, ns);
+}
 
-// --- Initialization and Main Driver ---
-static void initialize_parser(const char* source_code) {
-    g_source_code = source_code;
-    g_source_ptr = source_code;
-    g_current_line = 1;
-    g_current_col = 1;
-    g_start_col_for_token = 1;
-    g_symbol_count = 0;
-    
-    // Load the first token to prime the parser
-    advance();
+// One record per phase that ran, with what it found, in the order the phases ran
+static void record_phases(RecordWriter* w, const ParserOptions* options, const ParserResult* result) {
+    if (result->prefilter_ns >= 0) {
+        record_phase(w, "prefilter", result->prefilter_ns);
+        record_int(w, FIELD_STRUCTURAL, (long long)result->structural);
+        record_end(w);
+    }
+    if (result->parse_ns >= 0) {
+        record_phase(w, options->mode == PARSER_VALIDATE ? "validate" : "parse", result->parse_ns);
+        record_int(w, FIELD_TOKENS, result->tokens);
+        if (options->mode == PARSER_PARSE && options->threads > 0) {
+            record_int(w, FIELD_RANGES, result->ranges);
+        } else if (options->mode != PARSER_VALIDATE) {
+            record_int(w, FIELD_NODES, (long long)result->nodes);
+            record_int(w, FIELD_ARENA_BYTES, (long long)result->arena_bytes);
+            if (options->hash_cons) {
+                record_int(w, FIELD_EXPRESSIONS, (long long)result->expressions);
+                record_int(w, FIELD_UNIQUE, (long long)result->unique_expressions);
+                record_int(w, FIELD_SAVED_BYTES, (long long)result->saved_bytes);
+            }
+            if (result->pipelined) {
+                record_int(w, FIELD_LEXER_STALLS, result->lexer_stalls);
+                record_int(w, FIELD_LEXER_STALL_NS, result->lexer_stall_ns);
+                record_int(w, FIELD_PARSER_STALLS, result->parser_stalls);
+                record_int(w, FIELD_PARSER_STALL_NS, result->parser_stall_ns);
+            }
+        }
+        record_end(w);
+    }
+    if (result->optimize_ns >= 0) {
+        record_phase(w, "optimize", result->optimize_ns);
+        record_int(w, FIELD_LOOPS, result->loop_count);
+        record_int(w, FIELD_HOISTED, result->hoisted);
+        record_int(w, FIELD_REDUCED, result->reduced);
+        record_int(w, FIELD_TEMPORARIES, result->temporaries);
+        record_end(w);
+        for (int i = 0; i < result->loop_count; i++) {
+            const ParserLoopReport* loop = &result->loops[i];
+            record_begin(w, RECORD_LOOP);
+            record_int(w, FIELD_LINE, loop->line);
+            record_int(w, FIELD_COL, loop->col);
+            record_int(w, FIELD_OPS_BEFORE, loop->ops_before);
+            record_int(w, FIELD_OPS_AFTER, loop->ops_after);
+            record_int(w, FIELD_HOISTED, loop->hoisted);
+            record_int(w, FIELD_REDUCED, loop->reduced);
+            record_end(w);
+        }
+    }
+    if (result->run_ns >= 0) {
+        record_phase(w, "run", result->run_ns);
+        record_int(w, FIELD_STATEMENTS, result->statements);
+        record_int(w, FIELD_OPERATIONS, result->operations);
+        record_int(w, FIELD_ITERATIONS, result->iterations);
+        if (options->hash_cons) record_int(w, FIELD_MEMO_HITS, result->memo_hits);
+        if (options->eval_threads > 1) {
+            record_int(w, FIELD_TASKS, result->eval_tasks);
+            record_int(w, FIELD_BARRIERS, result->barriers);
+        }
+        if (result->status == PARSER_OK) record_int(w, FIELD_VALUE, result->value);
+        record_end(w);
+    }
+    static const char* const kind_names[] = {"block", "expression", "if", "while"};
+    for (int i = 0; i < result->profile_count; i++) {
+        const ParserProfileEntry* entry = &result->profile[i];
+        record_begin(w, RECORD_PROFILE);
+        record_int(w, FIELD_INDEX, i);
+        record_string(w, FIELD_KIND, kind_names[entry->kind]);
+        record_int(w, FIELD_LINE, entry->line);
+        record_int(w, FIELD_COL, entry->col);
+        record_int(w, FIELD_PARENT, entry->parent);
+        record_int(w, FIELD_COUNT, entry->count);
+        if (entry->kind == PARSER_PROFILE_WHILE) {
+            record_int(w, FIELD_ITERATIONS, entry->iterations);
+        } else if (entry->kind == PARSER_PROFILE_IF) {
+            record_int(w, FIELD_THEN, entry->then_taken);
+            record_int(w, FIELD_ELSE, entry->else_taken);
+        } else if (entry->kind == PARSER_PROFILE_BLOCK) {
+            record_int(w, FIELD_NS, entry->ns);
+            record_int(w, FIELD_SELF_NS, entry->self_ns);
+        }
+        record_end(w);
+    }
 }
 
-// Function to read entire file into a string
-char* read_file_to_string(const char* filename) {
-    FILE *file = fopen(filename, "rb"); // Open in binary mode to correctly get length
-    if (!file) {
-        perror("Error opening file");
-        return NULL;
+// Ends the run with a result record and the final flush
+static void record_result(RecordWriter* w, const char* verdict, size_t bytes, long long start) {
+    long long ns = parser_monotonic_ns() - start;
+    record_begin(w, RECORD_RESULT);
+    record_string(w, FIELD_VERDICT, verdict);
+    record_int(w, FIELD_BYTES, (long long)bytes);
+    record_int(w, FIELD_NS, ns);
+    record_end(w);
+    record_close(w);
+}
+
+// Reports a failure that has no source position, such as an unreadable file
+static void record_io_error(RecordWriter* w, const char* message, long long start) {
+    record_begin(w, RECORD_ERROR);
+    record_string(w, FIELD_KIND, "IO");
+    record_string(w, FIELD_MESSAGE, message);
+    record_end(w);
+    record_result(w, "error", 0, start);
+}
+
+// Reports a syntax or runtime error as text, or as the records that end the run
+static void report_parse_error(RecordWriter* w, const char* source, const ParserError* error,
+                               size_t bytes, long long start) {
+    if (!w) {
+        print_parse_error(source, error);
+        return;
     }
+    record_parse_error(w, error);
+    record_result(w, "invalid", bytes, start);
+}
 
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
+// -emit-c and -native: writes the C translation of source to c_path, and/or builds it
+// into native code and runs that. Leaves the last phase's result in *result.
+static void run_backend(RecordWriter* w, const ParserOptions* options, const char* source,
+                        const char* c_path, int native, ParserResult* result) {
+    if (c_path) {
+        FILE* out = fopen(c_path, "w");
+        if (out == NULL) {
+            memset(result, 0, sizeof(*result));
+            result->status = PARSER_BACKEND_ERROR;
+            result->error.kind = "Backend";
+            snprintf(result->error.message, sizeof(result->error.message), "Could not open '%s': %s", c_path, strerror(errno));
+            return;
+        }
+        parser_emit_c(source, options, out, result);
+        if (fclose(out) != 0 && result->status == PARSER_OK) {
+            result->status = PARSER_BACKEND_ERROR;
+            result->error.kind = "Backend";
+            snprintf(result->error.message, sizeof(result->error.message), "Could not write '%s': %s", c_path, strerror(errno));
+        }
+        if (w) {
+            record_phase(w, "translate", result->parse_ns);
+            record_int(w, FIELD_TOKENS, result->tokens);
+            record_int(w, FIELD_NODES, (long long)result->nodes);
+            record_end(w);
+        } else if (result->status == PARSER_OK) {
+            printf("\nWrote the C translation of %lu bytes to %s.\n", (unsigned long)result->bytes, c_path);
+        }
+        if (result->status != PARSER_OK || !native) {
+            return;
+        }
+    }
 
-    char *buffer = (char*)malloc(length + 1);
-    if (!buffer) {
-        fprintf(stderr, "Memory allocation failed for file buffer\n");
-        fclose(file);
-        return NULL;
+    ParserNative program;
+    if (parser_compile_native(source, options, &program, result) != PARSER_OK) {
+        return;
     }
+    if (w) {
+        record_phase(w, "compile", result->compile_ns);
+        record_int(w, FIELD_TOKENS, result->tokens);
+        record_int(w, FIELD_NODES, (long long)result->nodes);
+        record_end(w);
+    } else {
+        printf("\nCompiled %lu bytes to native code in %.1f ms.\n", (unsigned long)result->bytes, result->compile_ns / 1e6);
+    }
+    parser_run_native(&program, result);
+    parser_free_native(&program);
+    if (w) {
+        record_phase(w, "run", result->run_ns);
+        record_int(w, FIELD_ITERATIONS, result->iterations);
+        if (result->status == PARSER_OK) record_int(w, FIELD_VALUE, result->value);
+        record_end(w);
+    } else if (result->status == PARSER_OK) {
+        printf("Executed natively in %.3f ms: %ld loop iterations. Last value: %d\n",
+               result->run_ns / 1e6, result->iterations, result->value);
+    }
+}
 
-    if (fread(buffer, 1, length, file) != (size_t)length) {
-        fprintf(stderr, "Error reading file\n");
-        fclose(file);
-        free(buffer);
-        return NULL;
+// -profile-stacks: writes the profile of result as collapsed stacks to path
+static int write_collapsed_stacks(const char* path, const ParserResult* result) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Error opening the collapsed stacks file");
+        return 0;
     }
-    buffer[length] = '\0';
-    fclose(file);
-    return buffer;
+    parser_write_collapsed_stacks(result, out);
+    if (fclose(out) != 0) {
+        perror("Error writing the collapsed stacks file");
+        return 0;
+    }
+    return 1;
 }
 
-// =============5. Test Case Suite============== start
+// -files: processes every path with parser_process_files() and reports one verdict per
+// file, then a summary. Returns how many files are valid.
+static size_t run_files(RecordWriter* w, const ParserOptions* options, const char* const* paths, size_t count,
+                        long long start) {
+    ParserResult* results = (ParserResult*)calloc(count ? count : 1, sizeof(ParserResult));
+    ParserFileStats stats;
+    if (!results) {
+        fprintf(stderr, "Memory allocation failed for the file results\n");
+        exit(EXIT_FAILURE);
+    }
 
-// Process a single test case
-static void process_test_case(const char* test_input, int test_number, int is_valid_expected) {
-    printf("\n\n------------------------------------------\n");
-    printf("TEST CASE %d: %s\n", test_number, is_valid_expected ? "VALID" : "INVALID");
-    printf("------------------------------------------\n");
-    printf("Input: %s\n\n", test_input);
-    
-    // Reinitialize parser state
-    initialize_parser(test_input);
-    
-    int success = 1;
-    
-    // Skip the regular program call if we expect the test to fail
-    if (is_valid_expected) {
-        // Try to parse, but catch errors
-        int old_stderr = dup(STDERR_FILENO);
-        freopen("/dev/null", "w", stderr); // Redirect stderr to prevent error messages printing
-        
-        // Use a setjmp/longjmp to simulate try/catch
-        jmp_buf env;
-        int error_code = setjmp(env);
-        
-        if (!error_code) {
-            program(); // Start parsing
-            printf("✓ Program parsed successfully!\n");
+    size_t valid = parser_process_files(paths, count, options, results, &stats);
+    for (size_t i = 0; i < count; i++) {
+        const ParserResult* result = &results[i];
+        int ok = result->status == PARSER_OK;
+        if (w) {
+            record_begin(w, RECORD_FILE);
+            record_string(w, FIELD_PATH, paths[i]);
+            record_string(w, FIELD_VERDICT, ok ? "valid" : result->status == PARSER_IO_ERROR ? "error" : "invalid");
+            record_int(w, FIELD_BYTES, (long long)result->bytes);
+            record_int(w, FIELD_TOKENS, result->tokens);
+            record_int(w, FIELD_NS, result->parse_ns);
+            if (!ok) {
+                record_string(w, FIELD_KIND, result->error.kind);
+                record_string(w, FIELD_MESSAGE, result->error.message);
+                if (result->status != PARSER_IO_ERROR) {
+                    record_int(w, FIELD_LINE, result->error.line);
+                    record_int(w, FIELD_COL, result->error.col);
+                }
+            }
+            record_end(w);
+        } else if (ok) {
+            printf("%s: valid (%lu bytes, %ld tokens)\n", paths[i], (unsigned long)result->bytes, result->tokens);
+        } else if (result->status == PARSER_IO_ERROR) {
+            printf("%s: %s\n", paths[i], result->error.message);
         } else {
-            success = 0;
-            printf("✗ Parsing failed unexpectedly!\n");
+            printf("%s: invalid, %s Error on line %d, col %d: %s\n", paths[i], result->error.kind,
+                   result->error.line, result->error.col, result->error.message);
         }
-        
-        // Restore stderr
-        fflush(stderr);
-        dup2(old_stderr, STDERR_FILENO);
-        close(old_stderr);
+        parser_free_result(&results[i]);
+    }
+    free(results);
+
+    if (w) {
+        record_begin(w, RECORD_RESULT);
+        record_string(w, FIELD_VERDICT, valid == count ? "valid" : "invalid");
+        record_string(w, FIELD_READER, stats.io_uring ? "io_uring" : "pread");
+        record_int(w, FIELD_FILES, (long long)count);
+        record_int(w, FIELD_PASSED, (long long)valid);
+        record_int(w, FIELD_WORKERS, stats.workers);
+        record_int(w, FIELD_BYTES, (long long)stats.bytes);
+        record_int(w, FIELD_NS, parser_monotonic_ns() - start);
+        record_end(w);
+        record_close(w);
     } else {
-        // For invalid cases, we expect an error
-        int old_stderr = dup(STDERR_FILENO);
-        freopen("/dev/null", "w", stderr); // Redirect stderr
-        
-        // Use a setjmp/longjmp to simulate try/catch
-        jmp_buf env;
-        if (setjmp(env) == 0) {
-            program(); // Start parsing
-            printf("✗ Expected parsing to fail, but it succeeded!\n");
-            success = 0;
-        } else {
-            printf("✓ Parsing failed as expected for invalid input.\n");
+        printf("\n%lu of %lu files valid. Read %lu bytes with %s and parsed on %d worker(s) in %.3f ms.\n",
+               (unsigned long)valid, (unsigned long)count, (unsigned long)stats.bytes,
+               stats.io_uring ? "io_uring" : "pread", stats.workers, stats.ns / 1e6);
+    }
+    return valid;
+}
+
+// The test suite as records: one per test case and value check, then the result.
+// Returns 1 if everything passed.
+static int record_test_suite(RecordWriter* w, int valid_test_count) {
+    const int total_test_count = sizeof(test_cases) / sizeof(test_cases[0]);
+    long long suite_start = parser_monotonic_ns();
+    int passed = 0;
+    ParserOptions options;
+    cli_options(&options);
+
+    for (int i = 0; i < total_test_count; i++) {
+        ParserResult result;
+        int valid = parser_process(test_cases[i], &options, &result) == PARSER_OK;
+        int pass = valid == (i < valid_test_count);
+
+        passed += pass;
+        record_begin(w, RECORD_TEST);
+        record_int(w, FIELD_TEST, i + 1);
+        record_string(w, FIELD_EXPECTED, i < valid_test_count ? "valid" : "invalid");
+        record_string(w, FIELD_VERDICT, valid ? "valid" : "invalid");
+        record_int(w, FIELD_PASSED, pass);
+        record_int(w, FIELD_TOKENS, result.tokens);
+        record_int(w, FIELD_NS, result.parse_ns);
+        if (!valid) {
+            record_string(w, FIELD_MESSAGE, result.error.message);
+            record_int(w, FIELD_LINE, result.error.line);
+            record_int(w, FIELD_COL, result.error.col);
         }
-        
-        // Restore stderr
-        fflush(stderr);
-        dup2(old_stderr, STDERR_FILENO);
-        close(old_stderr);
+        record_end(w);
+        parser_free_result(&result);
     }
-    
-    printf("\nTest result: %s\n", success ? "PASS" : "FAIL");
+
+    // The value checks follow, numbered on; a skipped check counts as passed
+    const int check_count = sizeof(value_checks) / sizeof(value_checks[0]);
+    for (int i = 0; i < check_count; i++) {
+        char expected[64], verdict[160];
+        long long start = parser_monotonic_ns();
+        int pass = run_value_check(&value_checks[i], expected, sizeof(expected), verdict, sizeof(verdict)) != 0;
+
+        passed += pass;
+        record_begin(w, RECORD_TEST);
+        record_int(w, FIELD_TEST, total_test_count + i + 1);
+        record_string(w, FIELD_EXPECTED, expected);
+        record_string(w, FIELD_VERDICT, verdict);
+        record_int(w, FIELD_PASSED, pass);
+        record_int(w, FIELD_NS, parser_monotonic_ns() - start);
+        record_end(w);
+    }
+
+    record_begin(w, RECORD_RESULT);
+    record_string(w, FIELD_VERDICT, passed == total_test_count + check_count ? "pass" : "fail");
+    record_int(w, FIELD_TESTS, total_test_count + check_count);
+    record_int(w, FIELD_PASSED, passed);
+    record_int(w, FIELD_NS, parser_monotonic_ns() - suite_start);
+    record_end(w);
+    record_close(w);
+    return passed == total_test_count + check_count;
 }
 
-// =============5. Test Case Suite============== start
+// =============12. Structured Output============== end
 
 
+// Parses source with the trace on stdout. A syntax error is reported and ends the
+// program, as it always has in the menu.
+static void parse_with_trace(const char* source) {
+    ParserOptions options;
+    ParserResult result;
+    cli_options(&options);
+    options.trace = stdout;
+    
+    if (parser_process(source, &options, &result) != PARSER_OK) {
+        print_parse_error(source, &result.error);
+        exit(EXIT_FAILURE);
+    }
+    parser_free_result(&result);
+    printf("\n------------------------------------\n");
+    printf("Program parsed successfully!\n");
+    printf("------------------------------------\n");
+}
+
 // display menu for choosing test method
 void display_interactive_menu() {
     printf("\n=== Recursive Descent Parser - Interactive Menu ===\n");
@@ -751,26 +1124,35 @@ int main(int argc, char *argv[]) {
     int run_test_suite = 0;
     int use_console_input = 0;
     int interactive_mode = argc == 1; // If no arguments are provided, go to interactive mode
+    int parallel_threads = 0;         // Split the program across this many threads (0: sequential)
+    int validate_only = 0;            // Only answer valid/invalid with the validate-only engine
+    int use_prefilter = 0;            // Reject structurally broken input before parsing
+    int optimize_loops_flag = 0;      // Hoist loop invariants and strength-reduce, then report
+    int run_program_flag = 0;         // Execute the program with the tree interpreter
+    int dag_flag = 0;                 // Share identical subexpressions and memoize their values
+    const char* emit_c_path = NULL;   // Write the C translation of the program here
+    int native_flag = 0;              // Compile the program to native code and run it
+    int pipeline_flag = 0;            // Lex on a second thread, ahead of the parser
+    int eval_threads = 0;             // Run independent statements on this many threads
+    int profile_flag = 0;             // Execute with per-statement counts and per-block times
+    const char* stacks_path = NULL;   // Write the profile's collapsed stacks here
+    int files_flag = 0;               // The remaining arguments are files to check as one batch
+    int file_workers = 0;             // -files: parse on this many threads (0: one per CPU)
+    int pread_flag = 0;               // -files: read with pread rather than io_uring
+    OutputFormat output_format = OUTPUT_TEXT;
+    RecordWriter record_writer;
+    RecordWriter* records = NULL;     // Set when results are written as records
+    int show_usage = !interactive_mode;
+    int default_ltd = g_student_ltd_value;
+    int custom_ltd = 0;
     char filename[256];
 
-    printf("Recursive Descent Parser\n");
-    printf("Default LTD value: %d\n", g_student_ltd_value);
-    
-    if (!interactive_mode) {
-        printf("Usage: %s [-ltd NUM] [-test] [-console] [-interactive] [filename]\n", argv[0]);
-        printf("  -ltd NUM     : Set custom Last Three Digits value\n");
-        printf("  -test        : Run the test suite\n");
-        printf("  -console     : Read input from console\n");
-        printf("  -interactive : Show interactive menu\n");
-        printf("  filename     : Read input from specified file\n\n");
-    }
-
     // Parse command line arguments if not in interactive mode
     int arg_offset = 1;
     while (!interactive_mode && arg_offset < argc) {
         if (strcmp(argv[arg_offset], "-ltd") == 0 && arg_offset + 1 < argc) {
             g_student_ltd_value = atoi(argv[arg_offset + 1]);
-            printf("Using custom LTD value from command line: %d\n", g_student_ltd_value);
+            custom_ltd = 1;
             arg_offset += 2;
         } else if (strcmp(argv[arg_offset], "-test") == 0) {
             run_test_suite = 1;
@@ -781,10 +1163,128 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[arg_offset], "-interactive") == 0) {
             interactive_mode = 1;
             arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-parallel") == 0 && arg_offset + 1 < argc) {
+            parallel_threads = atoi(argv[arg_offset + 1]);
+            arg_offset += 2;
+        } else if (strcmp(argv[arg_offset], "-validate") == 0) {
+            validate_only = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-prefilter") == 0) {
+            use_prefilter = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-optimize") == 0) {
+            optimize_loops_flag = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-run") == 0) {
+            run_program_flag = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-dag") == 0) {
+            dag_flag = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-emit-c") == 0 && arg_offset + 1 < argc) {
+            emit_c_path = argv[arg_offset + 1];
+            arg_offset += 2;
+        } else if (strcmp(argv[arg_offset], "-native") == 0) {
+            native_flag = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-pipeline") == 0) {
+            pipeline_flag = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-eval-threads") == 0 && arg_offset + 1 < argc) {
+            eval_threads = atoi(argv[arg_offset + 1]);
+            arg_offset += 2;
+        } else if (strcmp(argv[arg_offset], "-profile") == 0) {
+            profile_flag = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-profile-stacks") == 0 && arg_offset + 1 < argc) {
+            profile_flag = 1;
+            stacks_path = argv[arg_offset + 1];
+            arg_offset += 2;
+        } else if (strcmp(argv[arg_offset], "-files") == 0) {
+            files_flag = 1;
+            arg_offset++;
+            break;
+        } else if (strcmp(argv[arg_offset], "-workers") == 0 && arg_offset + 1 < argc) {
+            file_workers = atoi(argv[arg_offset + 1]);
+            arg_offset += 2;
+        } else if (strcmp(argv[arg_offset], "-pread") == 0) {
+            pread_flag = 1;
+            arg_offset++;
+        } else if (strcmp(argv[arg_offset], "-limit") == 0 && arg_offset + 1 < argc) {
+            if (!parse_limit(&g_cli_limits, argv[arg_offset + 1])) {
+                fprintf(stderr, "Unknown limit '%s' (expected depth, tokens, bytes, time or arena=NUMBER)\n", argv[arg_offset + 1]);
+                return EXIT_FAILURE;
+            }
+            arg_offset += 2;
+        } else if (strcmp(argv[arg_offset], "-format") == 0 && arg_offset + 1 < argc) {
+            const char* format = argv[arg_offset + 1];
+            if (strcmp(format, "jsonl") == 0) {
+                output_format = OUTPUT_JSONL;
+            } else if (strcmp(format, "binary") == 0) {
+                output_format = OUTPUT_BINARY;
+            } else if (strcmp(format, "text") == 0) {
+                output_format = OUTPUT_TEXT;
+            } else {
+                fprintf(stderr, "Unknown output format '%s' (expected text, jsonl or binary)\n", format);
+                return EXIT_FAILURE;
+            }
+            arg_offset += 2;
         } else {
             break;
         }
     }
+    if (dag_flag && optimize_loops_flag) {
+        // The optimizer rewrites nodes in place, which a shared node cannot allow
+        fprintf(stderr, "-dag and -optimize cannot be combined\n");
+        return EXIT_FAILURE;
+    }
+    if (parallel_threads > 0 && (optimize_loops_flag || run_program_flag || dag_flag || pipeline_flag ||
+                                 profile_flag || eval_threads > 0)) {
+        // A parallel parse builds no tree, so there would be nothing to optimize or run
+        fprintf(stderr, "-parallel only checks the program and cannot be combined with -optimize, -run, -dag, -pipeline, -profile or -eval-threads\n");
+        return EXIT_FAILURE;
+    }
+
+    long long run_start = parser_monotonic_ns();
+    if (interactive_mode) {
+        output_format = OUTPUT_TEXT; // The menu is always text
+    }
+    if (output_format != OUTPUT_TEXT) {
+        record_open(&record_writer, output_format, STDOUT_FILENO);
+        records = &record_writer;
+    } else {
+        printf("Recursive Descent Parser\n");
+        printf("Default LTD value: %d\n", default_ltd);
+    }
+    
+    if (show_usage && !records) {
+        printf("Usage: %s [-ltd NUM] [-test] [-console] [-interactive] [-parallel N] [-validate] [-prefilter] [-optimize] [-run] [-dag] [-emit-c FILE] [-native] [-pipeline] [-eval-threads N] [-profile] [-profile-stacks FILE] [-limit NAME=N] [-format F] [-workers N] [-pread] [filename | -files FILE...]\n", argv[0]);
+        printf("  -ltd NUM     : Set custom Last Three Digits value\n");
+        printf("  -test        : Run the test suite\n");
+        printf("  -console     : Read input from console\n");
+        printf("  -interactive : Show interactive menu\n");
+        printf("  -parallel N  : Parse top-level statements on N threads (no trace)\n");
+        printf("  -validate    : Only check the program, without trace or evaluation\n");
+        printf("  -prefilter   : Reject unbalanced brackets, unclosed comments and bad characters first\n");
+        printf("  -optimize    : Hoist loop invariants, strength-reduce and print a report\n");
+        printf("  -run         : Execute the program and print execution statistics\n");
+        printf("  -dag         : Share identical subexpressions and report the deduplication\n");
+        printf("  -emit-c FILE : Write the program translated to C to FILE\n");
+        printf("  -native      : Compile the program with cc, load it and run it natively\n");
+        printf("  -pipeline    : Lex on a second thread and report how long each side waited\n");
+        printf("  -eval-threads N: Execute the program, running independent statements on N threads\n");
+        printf("  -profile     : Execute the program and print counts per statement and times per block\n");
+        printf("  -profile-stacks FILE: Also write the block times to FILE as collapsed stacks\n");
+        printf("  -limit NAME=N: Fail once depth, tokens, bytes, time (ms) or arena (bytes) exceeds N\n");
+        printf("  -format F    : Write results as text (default), jsonl or binary records\n");
+        printf("  -workers N   : With -files, parse on N threads (default: one per CPU)\n");
+        printf("  -pread       : With -files, read with pread even where io_uring is available\n");
+        printf("  filename     : Read input from specified file\n");
+        printf("  -files F... : Check every following file F in one batch\n\n");
+    }
+    if (custom_ltd && !records) {
+        printf("Using custom LTD value from command line: %d\n", g_student_ltd_value);
+    }
 
     // Interactive menu handling
     if (interactive_mode) {
@@ -809,20 +1309,7 @@ int main(int argc, char *argv[]) {
                         input_source = file_content;
                         
                         printf("\nParsing the following input:\n---\n%s\n---\n\n", input_source);
-                        initialize_parser(input_source);
-                        
-                        // Try to parse with error handling
-                        jmp_buf env;
-                        if (setjmp(env) == 0) {
-                            program();
-                            printf("\n------------------------------------\n");
-                            printf("Program parsed successfully!\n");
-                            printf("------------------------------------\n");
-                        } else {
-                            printf("\n------------------------------------\n");
-                            printf("Parsing failed!\n");
-                            printf("------------------------------------\n");
-                        }
+                        parse_with_trace(input_source);
                         
                         free(file_content);
                         file_content = NULL;
@@ -838,20 +1325,7 @@ int main(int argc, char *argv[]) {
                             
                             printf("\nParsing file: %s\n", filename);
                             printf("---\n%s\n---\n\n", input_source);
-                            initialize_parser(input_source);
-                            
-                            // Try to parse with error handling
-                            jmp_buf env;
-                            if (setjmp(env) == 0) {
-                                program();
-                                printf("\n------------------------------------\n");
-                                printf("Program parsed successfully!\n");
-                                printf("------------------------------------\n");
-                            } else {
-                                printf("\n------------------------------------\n");
-                                printf("Parsing failed!\n");
-                                printf("------------------------------------\n");
-                            }
+                            parse_with_trace(input_source);
                             
                             free(file_content);
                             file_content = NULL;
@@ -871,6 +1345,7 @@ int main(int argc, char *argv[]) {
                         for (int i = 0; i < total_test_count; i++) {
                             process_test_case(test_cases[i], i + 1, i < valid_test_count);
                         }
+                        process_value_checks();
                         
                         printf("\nTest suite completed.\n");
                     }
@@ -880,22 +1355,7 @@ int main(int argc, char *argv[]) {
                     input_source = test_cases[0];
                     
                     printf("\nParsing default test case:\n---\n%s\n---\n\n", input_source);
-                    initialize_parser(input_source);
-                    
-                    // Try to parse with error handling
-                    {
-                        jmp_buf env;
-                        if (setjmp(env) == 0) {
-                            program();
-                            printf("\n------------------------------------\n");
-                            printf("Program parsed successfully!\n");
-                            printf("------------------------------------\n");
-                        } else {
-                            printf("\n------------------------------------\n");
-                            printf("Parsing failed!\n");
-                            printf("------------------------------------\n");
-                        }
-                    }
+                    parse_with_trace(input_source);
                     break;
                     
                 case 5: // Change LTD value
@@ -934,55 +1394,134 @@ int main(int argc, char *argv[]) {
     
     // Process based on provided flags
     if (run_test_suite) {
-        printf("Running test suite...\n");
-        
         // Count of valid test cases (the first 4)
         const int valid_test_count = 4;
+        if (records) {
+            return record_test_suite(records, valid_test_count) ? 0 : EXIT_FAILURE;
+        }
+        printf("Running test suite...\n");
+        
         const int total_test_count = sizeof(test_cases) / sizeof(test_cases[0]);
+        int failed = 0;
         
         for (int i = 0; i < total_test_count; i++) {
-            process_test_case(test_cases[i], i + 1, i < valid_test_count);
+            failed += !process_test_case(test_cases[i], i + 1, i < valid_test_count);
         }
+        failed += process_value_checks();
         
         printf("\nTest suite completed.\n");
-        return 0;
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    if (files_flag) {
+        ParserOptions options;
+        cli_options(&options);
+        options.prefilter = use_prefilter;
+        options.mode = validate_only ? PARSER_VALIDATE : run_program_flag ? PARSER_EVALUATE : PARSER_PARSE;
+        options.batch_threads = file_workers > 0 ? file_workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        options.use_pread = pread_flag;
+        size_t count = (size_t)(argc - arg_offset);
+        size_t valid = run_files(records, &options, (const char* const*)&argv[arg_offset], count, run_start);
+        return valid == count ? 0 : EXIT_FAILURE;
     }
 
     // Get input source (priority: console > file > default test case)
     if (use_console_input) {
-        printf("Reading from console input...\n");
+        if (!records) printf("Reading from console input...\n");
         file_content = read_from_console();
         if (!file_content) {
+            if (records) record_io_error(records, "Could not read console input", run_start);
             return 1; // Error reading from console
         }
         input_source = file_content;
     }
     else if (argc > arg_offset) { // A filename is provided
-        printf("Attempting to read input from file: %s\n", argv[arg_offset]);
+        if (!records) printf("Attempting to read input from file: %s\n", argv[arg_offset]);
         file_content = read_file_to_string(argv[arg_offset]);
         if (!file_content) {
+            if (records) record_io_error(records, "Could not read input file", run_start);
             return 1; // Error reading file
         }
         input_source = file_content;
     } 
     else {
         // Default test case if no file is provided
-        printf("No input file provided. Using a default valid test case.\n");
+        if (!records) printf("No input file provided. Using a default valid test case.\n");
         input_source = test_cases[0]; // Use first test case as default
     }
+    size_t input_bytes = strlen(input_source);
+
+    ParserOptions options;
+    ParserResult result;
+    cli_options(&options);
+    options.prefilter = use_prefilter;
+    int backend = emit_c_path != NULL || native_flag;
+    if (backend) {
+        run_backend(records, &options, input_source, emit_c_path, native_flag, &result);
+    } else if (validate_only) {
+        options.mode = PARSER_VALIDATE;
+    } else if (parallel_threads > 0) {
+        options.threads = parallel_threads;
+    } else if (optimize_loops_flag || run_program_flag || dag_flag || pipeline_flag || profile_flag ||
+               eval_threads > 0 || records) {
+        // Records always carry node counts, so the tree is built for them too
+        options.mode = run_program_flag || profile_flag || eval_threads > 0 ? PARSER_EVALUATE : PARSER_PARSE;
+        options.profile = profile_flag;
+        options.eval_threads = eval_threads;
+        options.build_tree = 1;
+        options.optimize = optimize_loops_flag;
+        options.hash_cons = dag_flag;
+        options.pipeline = pipeline_flag;
+    } else {
+        // Show the input, then parse it with the trace
+        if (use_prefilter) {
+            options.mode = PARSER_PREFILTER;
+            if (parser_process(input_source, &options, &result) != PARSER_OK) {
+                print_parse_error(input_source, &result.error);
+                free(file_content);
+                return EXIT_FAILURE;
+            }
+            printf("\nPre-filter passed (%lu structural characters).\n", (unsigned long)result.structural);
+            options.mode = PARSER_PARSE;
+            options.prefilter = 0;
+        }
+        printf("\nParsing the following input:\n---\n%s\n---\n\n", input_source);
+        options.trace = stdout;
+    }
 
-    printf("\nParsing the following input:\n---\n%s\n---\n\n", input_source);
-
-    initialize_parser(input_source);
-    program(); // Start parsing
+    if (!backend) {
+        parser_process(input_source, &options, &result);
+        if (records) {
+            record_phases(records, &options, &result);
+        } else if (options.trace == NULL) {
+            print_results(&options, &result);
+        }
+        if (stacks_path && result.profile_count > 0 && !write_collapsed_stacks(stacks_path, &result)) {
+            parser_free_result(&result);
+            free(file_content);
+            if (records) record_io_error(records, "Could not write the collapsed stacks", run_start);
+            return EXIT_FAILURE;
+        }
+    }
+    if (result.status != PARSER_OK) {
+        report_parse_error(records, input_source, &result.error, input_bytes, run_start);
+        parser_free_result(&result);
+        free(file_content);
+        return EXIT_FAILURE;
+    }
+    parser_free_result(&result);
 
-    printf("\n------------------------------------\n");
-    printf("Program parsed successfully!\n");
-    printf("------------------------------------\n");
+    if (records) {
+        record_result(records, "valid", input_bytes, run_start);
+    } else {
+        printf("\n------------------------------------\n");
+        printf("Program parsed successfully!\n");
+        printf("------------------------------------\n");
+    }
 
     if (file_content) {
         free(file_content); // Clean up if content was read from file
     }
 
     return 0; // Success
-}
\ No newline at end of file
+}
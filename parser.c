@@ -0,0 +1,4379 @@
+// parser.c
+// Recursive Descent Parser for Control Structures and Nested Expressions
+// Library implementation; see parser.h for the interface and main.c for the command line.
+// Course: Programming Languages and Structures
+// Code by: Md. Alamin
+// Student ID: 134
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <setjmp.h>  // jmp_buf, setjmp, and longjmp
+#include <assert.h>  // The uses of a node's memo_value field exclude each other
+#include <stdint.h>  // uint32_t and uint64_t for the structural index
+#include <limits.h>  // INT_MAX caps the weights of parallel evaluation
+#include <pthread.h> // Worker threads for parallel parsing
+#include <stdatomic.h> // Indices of the pipelined lexer's token ring
+#include <sched.h>     // sched_yield while the token ring is full or empty
+#include <time.h>    // clock_gettime for phase timings
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>    // posix_spawnp runs the C compiler for the native backend
+#include <sys/wait.h>
+#include <dlfcn.h>    // dlopen loads the compiled program (link with -ldl on older systems)
+#include <sys/stat.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PARSER_HAVE_IO_URING 1
+#include <linux/io_uring.h> // Batch file reader; raw system calls, liburing is not needed
+#include <linux/stat.h>     // struct statx filled in by IORING_OP_STATX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h> // SSE2 intrinsics for the structural pre-pass
+#endif
+#include "parser.h"
+
+// --- Configuration ---
+
+#define SYMBOL_TABLE_MIN_CAPACITY 64 // The symbol table starts this large and doubles as it fills
+#define DEFAULT_LTD_VALUE 134 // Last Three Digits of Student ID
+static _Thread_local int g_ltd_value = DEFAULT_LTD_VALUE; // Value of LTD (ParserOptions.ltd_value)
+static _Thread_local FILE *g_trace_stream = NULL;        // Parse trace goes here when set (ParserOptions.trace)
+#define TRACE(...) do { if (g_trace_stream) fprintf(g_trace_stream, __VA_ARGS__); } while (0)
+
+// --- Memory ---
+// Everything the library allocates goes through the caller's ParserAllocator, or
+// malloc and free when there is none. The entry points set it for their thread.
+static _Thread_local const ParserAllocator *g_allocator = NULL;
+
+static void* parser_alloc(size_t size) {
+    return g_allocator ? g_allocator->alloc(size, g_allocator->context) : malloc(size);
+}
+
+static void parser_free(void* memory, size_t size) {
+    if (memory == NULL) {
+        return;
+    }
+    if (g_allocator) {
+        g_allocator->free(memory, size, g_allocator->context);
+    } else {
+        free(memory);
+    }
+}
+
+// Hooks have no realloc, so with them the block is copied and the old one freed
+static void* parser_realloc(void* memory, size_t old_size, size_t new_size) {
+    if (!g_allocator) {
+        return realloc(memory, new_size);
+    }
+    void* grown = parser_alloc(new_size);
+    if (grown && memory) {
+        memcpy(grown, memory, old_size < new_size ? old_size : new_size);
+        parser_free(memory, old_size);
+    }
+    return grown;
+}
+
+// Phase timings and pipeline stall times
+static long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+long long parser_monotonic_ns(void) {
+    return monotonic_ns();
+}
+
+// --- Global Variables for Lexer and Parser ---
+// Lexer and parser state is thread-local so that several threads can parse at once.
+static _Thread_local const char *g_source_code; // Start of the source code
+static _Thread_local const char *g_source_ptr;  // Pointer to the current character
+static _Thread_local const char *g_token_start; // First character of the current token
+
+// =============1. Lexer (Scanner) Implementation============== start
+// --- Token Definitions ---
+typedef enum {
+    TOKEN_EOF,
+    TOKEN_ERROR,
+
+    // Keywords
+    TOKEN_IF,
+    TOKEN_ELSE,
+    TOKEN_WHILE,
+
+    // Symbols
+    TOKEN_LBRACE,    // {
+    TOKEN_RBRACE,    // }
+    TOKEN_LPAREN,    // (
+    TOKEN_RPAREN,    // )
+    TOKEN_SEMICOLON, // ;
+
+    // Operators
+    TOKEN_PLUS,      // +
+    TOKEN_MINUS,     // -
+    TOKEN_MULTIPLY,  // *
+    TOKEN_DIVIDE,    // /
+
+    // Relational Operators
+    TOKEN_EQ,        // ==
+    TOKEN_NEQ,       // !=
+    TOKEN_LT,        // <
+    TOKEN_GT,        // >
+    TOKEN_LTE,       // <=
+    TOKEN_GTE,       // >=
+
+    // Literals and Identifiers
+    TOKEN_NUMBER,
+    TOKEN_IDENTIFIER,
+    TOKEN_LTD        // Special identifier "LTD"
+} TokenType;
+
+const char* token_type_to_string(TokenType type) {
+    switch (type) {
+        case TOKEN_EOF: return "EOF";
+        case TOKEN_ERROR: return "ERROR";
+        case TOKEN_IF: return "IF";
+        case TOKEN_ELSE: return "ELSE";
+        case TOKEN_WHILE: return "WHILE";
+        case TOKEN_LBRACE: return "LBRACE ('{')";
+        case TOKEN_RBRACE: return "RBRACE ('}')";
+        case TOKEN_LPAREN: return "LPAREN ('(')";
+        case TOKEN_RPAREN: return "RPAREN (')')";
+        case TOKEN_SEMICOLON: return "SEMICOLON (';')";
+        case TOKEN_PLUS: return "PLUS ('+')";
+        case TOKEN_MINUS: return "MINUS ('-')";
+        case TOKEN_MULTIPLY: return "MULTIPLY ('*')";
+        case TOKEN_DIVIDE: return "DIVIDE ('/')";
+        case TOKEN_EQ: return "EQ ('==')";
+        case TOKEN_NEQ: return "NEQ ('!=')";
+        case TOKEN_LT: return "LT ('<')";
+        case TOKEN_GT: return "GT ('>')";
+        case TOKEN_LTE: return "LTE ('<=')";
+        case TOKEN_GTE: return "GTE ('>=')";
+        case TOKEN_NUMBER: return "NUMBER";
+        case TOKEN_IDENTIFIER: return "IDENTIFIER";
+        case TOKEN_LTD: return "LTD";
+        default: return "UNKNOWN_TOKEN";
+    }
+}
+
+typedef struct {
+    TokenType type;
+    char value[100]; // Buffer for number value or identifier name
+    int line;        // Line number where the token starts
+    int col;         // Column number where the token starts
+} Token;
+
+typedef struct {
+    char name[100];
+    int value;
+} Symbol;
+
+// Identifiers of the tree being built, in order of first use. The table and its hash
+// index grow through parser_realloc() and are released with the tree by free_symbol_table().
+static _Thread_local Symbol *g_symbol_table = NULL;
+static _Thread_local int g_symbol_count = 0;
+static _Thread_local int g_symbol_capacity = 0;
+static _Thread_local int *g_symbol_slots = NULL; // Open addressing, 2 * capacity slots: symbol index + 1, or 0
+
+// --- Global Variables for Lexer and Parser ---
+static _Thread_local Token g_current_token;      // The current token being processed by the parser
+static _Thread_local int g_current_line = 1;     // Current line number in the source
+static _Thread_local int g_current_col = 1;      // Current column number in the source
+static _Thread_local int g_start_col_for_token = 1; // Column where the current token began
+static _Thread_local long g_token_count = 0;     // Tokens scanned since the parser was initialized (including EOF)
+static _Thread_local struct TokenRing *g_token_ring = NULL; // When set, advance() takes tokens from a lexer thread
+
+// A syntax error captured at the point it was raised, so it can be reported later
+// (or by another thread) exactly as error_at_current_token would have printed it.
+typedef struct {
+    const char *kind;        // "Syntax" or "Runtime"
+    char message[256];
+    Token token;             // Token the error was reported at
+    const char *source_code; // Source buffer the token belongs to
+    const char *source_ptr;  // Lexer position when the error was raised (selects the line to print)
+    ParserStatus limit;      // Which limit a "Limit" error is about
+} ParseError;
+
+static _Thread_local ParseError g_last_error;     // Most recent error raised on this thread
+static _Thread_local jmp_buf *g_error_jmp = NULL; // Errors longjmp here; every entry point sets it
+
+// =============9. Abstract Syntax Tree============== start
+// When g_ast_arena is set, the parser functions return a tree of Nodes allocated
+// from it; otherwise they only check the syntax and return NULL.
+
+typedef enum {
+    NODE_BLOCK,      // left: first statement (statements are chained through next)
+    NODE_IF,         // left: condition, right: then-block, extra: else-block or NULL
+    NODE_WHILE,      // left: condition, right: body, extra: hoisted pre-header (NODE_HOIST chain),
+                     // value: how many pre-header entries the condition needs
+    NODE_EXPR_STMT,  // left: expression
+    NODE_CONDITION,  // op: relational operator, left/right: operands
+    NODE_BINARY,     // op: '+', '-', '*' or '/', left/right: operands
+    NODE_SHIFT_LEFT, // left * 2^value, computed with a shift
+    NODE_SHIFT_DIV,  // left / 2^value, computed with a shift that rounds toward zero like '/'
+    NODE_NUMBER,     // value: the literal
+    NODE_IDENTIFIER, // value: index in g_symbol_table
+    NODE_LTD,        // The LTD value
+    NODE_TEMP,       // value: temporary holding a hoisted subexpression
+    NODE_HOIST       // value: temporary assigned before the loop, left: its expression
+} NodeType;
+
+typedef struct Node {
+    NodeType type;
+    TokenType op;       // Operator of NODE_BINARY and NODE_CONDITION
+    int value;          // Literal, symbol index, shift amount or temporary index
+    int line;           // Source position of the node's token
+    int col;
+    int flags;          // NODE_SHARED, NODE_MAY_TRAP, NODE_MEMOIZED (expression DAG), NODE_BARRIER,
+                        // NODE_PROFILED, NODE_WEIGHTED
+    union {             // At most one per node, as the flags say
+        int memo_value;    // NODE_MEMOIZED: value computed during run number memo_epoch
+        int profile_index; // NODE_PROFILED statement or block: its ParserProfileEntry
+        int weight;        // NODE_WEIGHTED statement or block: work for parallel evaluation
+    };
+    unsigned memo_epoch;
+    struct Node *left;
+    struct Node *right;
+    struct Node *extra;
+    struct Node *next;  // Next statement in a block, next NODE_HOIST of a pre-header
+} Node;
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// Bump allocator for tree nodes; everything is released at once by arena_free().
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    size_t size;
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head;
+    size_t bytes;       // Bytes handed out
+    size_t node_count;  // Nodes allocated by new_node()
+    struct Node *free_nodes; // Nodes given back by release_node(), reused first
+} Arena;
+
+#define ARENA_HEADER_SIZE ((sizeof(ArenaChunk) + 15) & ~(size_t)15)
+#define ARENA_NODE_SIZE ((sizeof(Node) + 15) & ~(size_t)15)
+
+static void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    ArenaChunk* chunk = arena->head;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        chunk = (ArenaChunk*)parser_alloc(ARENA_HEADER_SIZE + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = arena->head;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        arena->head = chunk;
+    }
+    void* memory = (char*)chunk + ARENA_HEADER_SIZE + chunk->used;
+    chunk->used += size;
+    arena->bytes += size;
+    return memory;
+}
+
+static void arena_free(Arena* arena) {
+    while (arena->head != NULL) {
+        ArenaChunk* next = arena->head->next;
+        parser_free(arena->head, ARENA_HEADER_SIZE + arena->head->size);
+        arena->head = next;
+    }
+    arena->bytes = 0;
+    arena->node_count = 0;
+    arena->free_nodes = NULL;
+}
+
+static Node* new_node(Arena* arena, NodeType type, int line, int col) {
+    Node* node = arena->free_nodes;
+    if (node) {
+        arena->free_nodes = node->next;
+        arena->bytes += ARENA_NODE_SIZE;
+    } else {
+        node = (Node*)arena_alloc(arena, sizeof(Node));
+    }
+    if (node) {
+        memset(node, 0, sizeof(*node));
+        node->type = type;
+        node->line = line;
+        node->col = col;
+        arena->node_count++;
+    }
+    return node;
+}
+
+// Gives back a node nothing points to, for the next new_node()
+static void release_node(Arena* arena, Node* node) {
+    node->next = arena->free_nodes;
+    arena->free_nodes = node;
+    arena->bytes -= ARENA_NODE_SIZE;
+    arena->node_count--;
+}
+
+static _Thread_local Arena *g_ast_arena = NULL; // Parser functions build a tree into this arena when set
+
+// --- Hash-consing ---
+// When g_dag_table is also set, each completed expression node is looked up by its
+// type, operator, value and children, so that identical subexpressions share one node
+// and the tree becomes a DAG. Nodes that may raise a runtime error also key on their
+// position, so errors are still reported where they occur.
+
+#define NODE_SHARED   1 // Stands for more than one occurrence in the source
+#define NODE_MAY_TRAP 2 // Contains a division by something other than a nonzero literal
+#define NODE_MEMOIZED 4 // The interpreter evaluates it once per run
+#define NODE_BARRIER  8 // Statement that a parallel evaluation starts only after the ones before it
+#define NODE_PROFILED 16 // Has a profile_index
+#define NODE_WEIGHTED 32 // Has a weight
+
+#define DAG_INITIAL_CAPACITY 1024
+
+typedef struct {
+    Node **slots;       // Open addressing; capacity is a power of two
+    size_t capacity;
+    size_t count;       // Distinct expression nodes
+    size_t requests;    // Expression nodes the parser completed
+} DagTable;
+
+static _Thread_local DagTable *g_dag_table = NULL;
+
+static size_t dag_hash(const Node* node) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL;
+    uint64_t parts[7] = {(uint64_t)node->type, (uint64_t)node->op, (uint64_t)(unsigned)node->value,
+                         (uint64_t)(uintptr_t)node->left, (uint64_t)(uintptr_t)node->right, 0, 0};
+    if (node->flags & NODE_MAY_TRAP) {
+        parts[5] = (uint64_t)(unsigned)node->line;
+        parts[6] = (uint64_t)(unsigned)node->col;
+    }
+    for (int i = 0; i < 7; i++) {
+        h = (h ^ parts[i]) * 0x100000001B3ULL;
+        h ^= h >> 29;
+    }
+    return (size_t)h;
+}
+
+static int dag_equal(const Node* a, const Node* b) {
+    if (a->type != b->type || a->op != b->op || a->value != b->value ||
+        a->left != b->left || a->right != b->right ||
+        (a->flags & NODE_MAY_TRAP) != (b->flags & NODE_MAY_TRAP)) {
+        return 0;
+    }
+    return !(a->flags & NODE_MAY_TRAP) || (a->line == b->line && a->col == b->col);
+}
+
+// Doubles the table (or creates it). Returns 0 if there is no memory for it.
+static int dag_grow(DagTable* table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : DAG_INITIAL_CAPACITY;
+    Node** slots = (Node**)parser_alloc(capacity * sizeof(Node*));
+    if (!slots) {
+        return 0;
+    }
+    memset(slots, 0, capacity * sizeof(Node*));
+    for (size_t i = 0; i < table->capacity; i++) {
+        Node* node = table->slots[i];
+        if (node) {
+            size_t j = dag_hash(node) & (capacity - 1);
+            while (slots[j]) j = (j + 1) & (capacity - 1);
+            slots[j] = node;
+        }
+    }
+    parser_free(table->slots, table->capacity * sizeof(Node*));
+    table->slots = slots;
+    table->capacity = capacity;
+    return 1;
+}
+
+static void free_dag_table(DagTable* table) {
+    parser_free(table->slots, table->capacity * sizeof(Node*));
+    table->slots = NULL;
+    table->capacity = 0;
+}
+
+// Returns the shared node equal to the just-completed expression node, giving the
+// new node back to the arena if there already is one.
+static Node* intern_node(Node* node) {
+    DagTable* table = g_dag_table;
+    if (table == NULL || node == NULL) {
+        return node;
+    }
+
+    int trap = node->type == NODE_BINARY && node->op == TOKEN_DIVIDE &&
+               !(node->right->type == NODE_NUMBER && node->right->value != 0);
+    if (trap || (node->left && (node->left->flags & NODE_MAY_TRAP)) ||
+        (node->right && (node->right->flags & NODE_MAY_TRAP))) {
+        node->flags |= NODE_MAY_TRAP;
+    }
+    if (node->type == NODE_BINARY || node->type == NODE_CONDITION) {
+        node->flags |= NODE_MEMOIZED;
+    }
+
+    table->requests++;
+    if ((table->count + 1) * 2 > table->capacity && !dag_grow(table)) {
+        table->count++; // Out of memory: the node is simply not shared
+        return node;
+    }
+    size_t i = dag_hash(node) & (table->capacity - 1);
+    for (Node* existing; (existing = table->slots[i]) != NULL; i = (i + 1) & (table->capacity - 1)) {
+        if (dag_equal(existing, node)) {
+            existing->flags |= NODE_SHARED;
+            release_node(g_ast_arena, node);
+            return existing;
+        }
+    }
+    table->slots[i] = node;
+    table->count++;
+    return node;
+}
+
+// =============9. Abstract Syntax Tree============== end
+
+// --- Forward Declarations for Parser Functions ---
+static Node* program();
+static Node* block();
+static Node* block_statements(const char* stop);
+static Node* statement();
+static Node* if_statement();
+static Node* while_statement();
+static Node* condition();
+static TokenType relational_operator();
+static Node* expression();
+static Node* term();
+static Node* factor();
+
+// Error handling forward declarations
+static void error_at_current_token(const char* message);
+static void raise_at_current_token(const char* kind, const char* message);
+
+static void free_symbol_table(void) {
+    parser_free(g_symbol_table, g_symbol_capacity * sizeof(Symbol));
+    parser_free(g_symbol_slots, g_symbol_capacity * 2 * sizeof(int));
+    g_symbol_table = NULL;
+    g_symbol_slots = NULL;
+    g_symbol_count = 0;
+    g_symbol_capacity = 0;
+}
+
+static unsigned symbol_hash(const char* name) {
+    unsigned hash = 2166136261u; // FNV-1a
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+// Doubles the table and rebuilds the hash index. Returns 0 when out of memory.
+static int grow_symbol_table(void) {
+    int capacity = g_symbol_capacity ? g_symbol_capacity * 2 : SYMBOL_TABLE_MIN_CAPACITY;
+    int* slots = (int*)parser_alloc(capacity * 2 * sizeof(int));
+    if (!slots) {
+        return 0;
+    }
+    Symbol* table = (Symbol*)parser_realloc(g_symbol_table, g_symbol_capacity * sizeof(Symbol),
+                                            capacity * sizeof(Symbol));
+    if (!table) {
+        parser_free(slots, capacity * 2 * sizeof(int));
+        return 0;
+    }
+    g_symbol_table = table;
+    parser_free(g_symbol_slots, g_symbol_capacity * 2 * sizeof(int));
+    g_symbol_slots = slots;
+    g_symbol_capacity = capacity;
+    memset(slots, 0, capacity * 2 * sizeof(int));
+    for (int i = 0; i < g_symbol_count; i++) {
+        unsigned slot = symbol_hash(table[i].name) & (capacity * 2 - 1);
+        while (slots[slot] != 0) slot = (slot + 1) & (capacity * 2 - 1);
+        slots[slot] = i + 1;
+    }
+    return 1;
+}
+
+// Function to look up or add a symbol, returning its index in the symbol table
+static int get_symbol_index(const char* name) {
+    if (g_symbol_count == g_symbol_capacity && !grow_symbol_table()) {
+        raise_at_current_token("Memory", "Memory allocation failed for symbol table");
+    }
+    unsigned mask = g_symbol_capacity * 2 - 1;
+    unsigned slot = symbol_hash(name) & mask;
+    for (; g_symbol_slots[slot] != 0; slot = (slot + 1) & mask) {
+        if (strcmp(g_symbol_table[g_symbol_slots[slot] - 1].name, name) == 0) {
+            return g_symbol_slots[slot] - 1;
+        }
+    }
+
+    // Add new symbol with dummy value (0)
+    strcpy(g_symbol_table[g_symbol_count].name, name);
+    g_symbol_table[g_symbol_count].value = 0; // Default value
+    g_symbol_slots[slot] = g_symbol_count + 1;
+    return g_symbol_count++;
+}
+
+
+// =============3. Error Handling============== start
+
+static void raise_at_current_token(const char* kind, const char* message) {
+    g_last_error.kind = kind;
+    snprintf(g_last_error.message, sizeof(g_last_error.message), "%s", message);
+    g_last_error.token = g_current_token;
+    g_last_error.source_code = g_source_code;
+    g_last_error.source_ptr = g_source_ptr;
+    
+    // Every entry point arms g_error_jmp and reports the error as a value
+    longjmp(*g_error_jmp, 1);
+}
+
+static void error_at_current_token(const char* message) {
+    raise_at_current_token("Syntax", message);
+}
+
+// --- Resource Limits ---
+// Budgets of ParserOptions.limits for the call in progress on this thread; every
+// limit fails the call with its own status. The clock is read only every
+// LIMIT_CHECK_INTERVAL tokens or loop iterations.
+
+#define LIMIT_CHECK_INTERVAL 1024 // Power of two
+
+typedef struct {
+    int max_depth;
+    long max_tokens;
+    size_t max_arena_bytes;
+    long long deadline_ns;  // monotonic_ns() at which the time limit runs out (0: none)
+    long long max_time_ns;  // For the message
+} Limits;
+
+static _Thread_local const Limits *g_limits = NULL; // NULL when the call has no limits
+static _Thread_local int g_nesting = 0;             // '{' and '(' the parser is inside
+
+static void raise_limit(ParserStatus limit, const char* message) {
+    g_last_error.limit = limit;
+    raise_at_current_token("Limit", message);
+}
+
+// Message for an exceeded limit; value is what the limit was set to
+static void format_limit_message(char* buffer, size_t size, ParserStatus limit, long long value) {
+    switch (limit) {
+        case PARSER_DEPTH_LIMIT: snprintf(buffer, size, "Nesting depth limit of %lld exceeded", value); break;
+        case PARSER_TOKEN_LIMIT: snprintf(buffer, size, "Token limit of %lld exceeded", value); break;
+        case PARSER_INPUT_LIMIT: snprintf(buffer, size, "Input exceeds the limit of %lld bytes", value); break;
+        case PARSER_TIME_LIMIT: snprintf(buffer, size, "Time limit of %.3f ms exceeded", value / 1e6); break;
+        default: snprintf(buffer, size, "Syntax tree exceeds the arena limit of %lld bytes", value); break;
+    }
+}
+
+// Token and time budgets; tokens is the count including the token being consumed
+static ParserStatus check_token_limits(const Limits* limits, long tokens) {
+    if (limits->max_tokens && tokens > limits->max_tokens) {
+        return PARSER_TOKEN_LIMIT;
+    }
+    if (limits->deadline_ns && (tokens & (LIMIT_CHECK_INTERVAL - 1)) == 0 && monotonic_ns() > limits->deadline_ns) {
+        return PARSER_TIME_LIMIT;
+    }
+    return PARSER_OK;
+}
+
+static void raise_if_limit(ParserStatus limit) {
+    if (limit != PARSER_OK) {
+        char message[128];
+        format_limit_message(message, sizeof(message), limit, limit == PARSER_TOKEN_LIMIT ?
+                             g_limits->max_tokens : g_limits->max_time_ns);
+        raise_limit(limit, message);
+    }
+}
+
+// After consuming '{' or '('
+static void enter_nesting() {
+    if (g_limits && g_limits->max_depth && ++g_nesting > g_limits->max_depth) {
+        char message[128];
+        format_limit_message(message, sizeof(message), PARSER_DEPTH_LIMIT, g_limits->max_depth);
+        raise_limit(PARSER_DEPTH_LIMIT, message);
+    }
+}
+
+// After consuming the matching '}' or ')'
+static void leave_nesting() {
+    if (g_limits && g_limits->max_depth) {
+        g_nesting--; // Only counted while a depth limit is set
+    }
+}
+
+// --- Lexer Implementation ---
+static Token make_token(TokenType type, const char* value_str, int line, int col) {
+    Token token;
+    token.type = type;
+    if (value_str != NULL) {
+        strncpy(token.value, value_str, sizeof(token.value) - 1);
+        token.value[sizeof(token.value) - 1] = '\0';
+    } else {
+        token.value[0] = '\0';
+    }
+    token.line = line;
+    token.col = col;
+    return token;
+}
+
+static void skip_whitespace_and_comments() {
+    while (*g_source_ptr != '\0') {
+        if (isspace((unsigned char)*g_source_ptr)) {
+            if (*g_source_ptr == '\n') {
+                g_current_line++;
+                g_current_col = 1;
+            } else {
+                g_current_col++;
+            }
+            g_source_ptr++;
+        } 
+        // Handle C-style comments
+        else if (*g_source_ptr == '/' && *(g_source_ptr + 1) == '*') {
+            g_source_ptr += 2; // Skip /*
+            g_current_col += 2;
+            
+            while (!(*g_source_ptr == '*' && *(g_source_ptr + 1) == '/') && *g_source_ptr != '\0') {
+                if (*g_source_ptr == '\n') {
+                    g_current_line++;
+                    g_current_col = 1;
+                } else {
+                    g_current_col++;
+                }
+                g_source_ptr++;
+            }
+            
+            if (*g_source_ptr == '\0') {
+                // Unclosed comment
+                error_at_current_token("Unclosed comment detected");
+            } else {
+                g_source_ptr += 2; // Skip */
+                g_current_col += 2;
+            }
+        }
+        // Handle C++-style comments
+        else if (*g_source_ptr == '/' && *(g_source_ptr + 1) == '/') {
+            g_source_ptr += 2; // Skip //
+            g_current_col += 2;
+            
+            while (*g_source_ptr != '\n' && *g_source_ptr != '\0') {
+                g_source_ptr++;
+                g_current_col++;
+            }
+        }
+        else {
+            break; // Not whitespace or comment
+        }
+    }
+}
+
+static Token lexer_get_next_token_internal() {
+    skip_whitespace_and_comments();
+    g_token_start = g_source_ptr;
+    g_start_col_for_token = g_current_col; // Record column at start of token
+
+    if (*g_source_ptr == '\0') {
+        return make_token(TOKEN_EOF, "EOF", g_current_line, g_start_col_for_token);
+    }
+
+    char current_char = *g_source_ptr;
+    char next_char = *(g_source_ptr + 1);
+
+    // Multi-character operators (==, !=, <=, >=)
+    if (current_char == '=' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_EQ, "==", g_current_line, g_start_col_for_token); }
+    if (current_char == '!' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_NEQ, "!=", g_current_line, g_start_col_for_token); }
+    if (current_char == '<' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_LTE, "<=", g_current_line, g_start_col_for_token); }
+    if (current_char == '>' && next_char == '=') { g_source_ptr += 2; g_current_col += 2; return make_token(TOKEN_GTE, ">=", g_current_line, g_start_col_for_token); }
+
+    // Single-character symbols and operators
+    char single_char_val[2] = {current_char, '\0'};
+    g_source_ptr++; g_current_col++;
+    switch (current_char) {
+        case '{': return make_token(TOKEN_LBRACE, single_char_val, g_current_line, g_start_col_for_token);
+        case '}': return make_token(TOKEN_RBRACE, single_char_val, g_current_line, g_start_col_for_token);
+        case '(': return make_token(TOKEN_LPAREN, single_char_val, g_current_line, g_start_col_for_token);
+        case ')': return make_token(TOKEN_RPAREN, single_char_val, g_current_line, g_start_col_for_token);
+        case ';': return make_token(TOKEN_SEMICOLON, single_char_val, g_current_line, g_start_col_for_token);
+        case '+': return make_token(TOKEN_PLUS, single_char_val, g_current_line, g_start_col_for_token);
+        case '-': return make_token(TOKEN_MINUS, single_char_val, g_current_line, g_start_col_for_token);
+        case '*': return make_token(TOKEN_MULTIPLY, single_char_val, g_current_line, g_start_col_for_token);
+        case '/': return make_token(TOKEN_DIVIDE, single_char_val, g_current_line, g_start_col_for_token);
+        case '<': return make_token(TOKEN_LT, single_char_val, g_current_line, g_start_col_for_token);
+        case '>': return make_token(TOKEN_GT, single_char_val, g_current_line, g_start_col_for_token);
+    }
+    // Backtrack if not a recognized single character
+    g_source_ptr--; g_current_col--;
+
+    // Numbers: <digit> { <digit> }
+    if (isdigit((unsigned char)current_char)) {
+        char num_buffer[100];
+        int i = 0;
+        num_buffer[i++] = current_char;
+        g_source_ptr++; g_current_col++;
+        while (*g_source_ptr != '\0' && isdigit((unsigned char)*g_source_ptr)) {
+            if (i < sizeof(num_buffer) - 1) num_buffer[i++] = *g_source_ptr;
+            g_source_ptr++; g_current_col++;
+        }
+        num_buffer[i] = '\0';
+        return make_token(TOKEN_NUMBER, num_buffer, g_current_line, g_start_col_for_token);
+    }
+
+    // Identifiers and Keywords: <letter> { <letter> | <digit> } (allow underscore)
+    if (isalpha((unsigned char)current_char) || current_char == '_') {
+        char id_buffer[100];
+        int i = 0;
+        id_buffer[i++] = current_char;
+        g_source_ptr++; g_current_col++;
+        while (*g_source_ptr != '\0' && (isalnum((unsigned char)*g_source_ptr) || *g_source_ptr == '_')) {
+            if (i < sizeof(id_buffer) - 1) id_buffer[i++] = *g_source_ptr;
+            g_source_ptr++; g_current_col++;
+        }
+        id_buffer[i] = '\0';
+
+        // Check for keywords
+        if (strcmp(id_buffer, "if") == 0) return make_token(TOKEN_IF, id_buffer, g_current_line, g_start_col_for_token);
+        if (strcmp(id_buffer, "else") == 0) return make_token(TOKEN_ELSE, id_buffer, g_current_line, g_start_col_for_token);
+        if (strcmp(id_buffer, "while") == 0) return make_token(TOKEN_WHILE, id_buffer, g_current_line, g_start_col_for_token);
+        if (strcmp(id_buffer, "LTD") == 0) return make_token(TOKEN_LTD, id_buffer, g_current_line, g_start_col_for_token);
+
+        return make_token(TOKEN_IDENTIFIER, id_buffer, g_current_line, g_start_col_for_token);
+    }
+
+    // If no rule matches, it's an unrecognized character
+    char error_char_val[2] = {current_char, '\0'};
+    g_source_ptr++; g_current_col++; // Consume the erroneous character to avoid infinite loop
+    Token err_token = make_token(TOKEN_ERROR, error_char_val, g_current_line, g_start_col_for_token);
+    // Error will be reported by advance()
+    return err_token;
+}
+
+// =============1. Lexer (Scanner) Implementation============== end
+
+// --- Parser Helper Functions ---
+// Consumes the current token and gets the next one from the lexer.
+static void ring_next_token(struct TokenRing* ring);
+
+static void advance() {
+    g_token_count++;
+    if (g_limits) {
+        raise_if_limit(check_token_limits(g_limits, g_token_count));
+    }
+    if (g_token_ring) {
+        ring_next_token(g_token_ring);
+    } else {
+        g_current_token = lexer_get_next_token_internal();
+    }
+    if (g_current_token.type == TOKEN_ERROR) {
+        char error_msg[150];
+        sprintf(error_msg, "Lexical error: Unrecognized character '%s'", g_current_token.value);
+        error_at_current_token(error_msg);
+    }
+}
+
+// Checks if the current token matches the expected type.
+// If yes, consumes it (advances). If no, reports an error.
+static void eat(TokenType expected_type, const char* error_message) {
+    if (g_current_token.type == expected_type) {
+        advance();
+    } else {
+        char full_error_message[256];
+        sprintf(full_error_message, "%s. Expected %s, but got %s ('%s').",
+                error_message,
+                token_type_to_string(expected_type),
+                token_type_to_string(g_current_token.type),
+                g_current_token.value);
+        error_at_current_token(full_error_message);
+    }
+}
+// =============3. Error Handling============== end
+
+// =============2. Recursive Descent Parser============== start
+// --- Tree Building Helpers ---
+// Allocates a node at the current token when a tree is being built, NULL otherwise.
+static Node* parse_node(NodeType type) {
+    if (g_ast_arena == NULL) {
+        return NULL;
+    }
+    if (g_limits && g_limits->max_arena_bytes && g_ast_arena->bytes + ARENA_NODE_SIZE > g_limits->max_arena_bytes) {
+        char message[128];
+        format_limit_message(message, sizeof(message), PARSER_ARENA_LIMIT, (long long)g_limits->max_arena_bytes);
+        raise_limit(PARSER_ARENA_LIMIT, message);
+    }
+    Node* node = new_node(g_ast_arena, type, g_current_token.line, g_current_token.col);
+    if (!node) {
+        raise_at_current_token("Memory", "Memory allocation failed for syntax tree");
+    }
+    return node;
+}
+
+// Node for "left op right"; op is the current token, which the caller has not consumed yet.
+static Node* parse_binary_node(NodeType type, Node* left) {
+    Node* node = parse_node(type);
+    if (node) {
+        node->op = g_current_token.type;
+        node->left = left;
+    }
+    return node;
+}
+
+// --- Recursive Descent Parser Functions ---
+// <program> -> <block>
+static Node* program() {
+    TRACE("Parsing <program>...\n");
+    Node* tree = block();
+    if (g_current_token.type != TOKEN_EOF) {
+        error_at_current_token("Expected end of input (EOF) after program block, but found more tokens.");
+    }
+    TRACE("Finished parsing <program>.\n");
+    return tree;
+}
+
+// <block> -> "{" { <statement> } "}"
+static Node* block() {
+    TRACE("Parsing <block>...\n");
+    Node* node = parse_node(NODE_BLOCK);
+    eat(TOKEN_LBRACE, "Expected '{' to start a block");
+    enter_nesting();
+    Node* statements = block_statements(NULL);
+    if (node) node->left = statements;
+    eat(TOKEN_RBRACE, "Expected '}' to end a block");
+    leave_nesting();
+    TRACE("Finished parsing <block>.\n");
+    return node;
+}
+
+// { <statement> } of a block. Stops before '}' or EOF, or (when stop is not NULL)
+// at the first statement that starts at or after stop. Returns the statement chain.
+static Node* block_statements(const char* stop) {
+    Node* first = NULL;
+    Node** link = &first;
+    while (g_current_token.type != TOKEN_RBRACE && g_current_token.type != TOKEN_EOF) {
+        if (stop != NULL && g_token_start >= stop) {
+            break;
+        }
+        // Check if the current token can start a statement
+        TokenType tt = g_current_token.type;
+        if (tt == TOKEN_IF || tt == TOKEN_WHILE || // Keywords for statements
+            tt == TOKEN_LPAREN ||                   // Start of ( <expression> ) ;
+            tt == TOKEN_IDENTIFIER || tt == TOKEN_NUMBER || tt == TOKEN_LTD) { // Start of <expression> ;
+            Node* node = statement();
+            if (node) {
+                *link = node;
+                link = &node->next;
+            }
+        } else {
+            error_at_current_token("Invalid token inside block. Expected a statement or '}'.");
+            break;
+        }
+    }
+    return first;
+}
+
+// <statement> -> <if-statement> | <while-statement> | <expression> ";"
+static Node* statement() {
+    Node* node = NULL;
+    TRACE("Parsing <statement> (current token: %s)...\n", token_type_to_string(g_current_token.type));
+    if (g_current_token.type == TOKEN_IF) {
+        node = if_statement();
+    } else if (g_current_token.type == TOKEN_WHILE) {
+        node = while_statement();
+    } else if (g_current_token.type == TOKEN_LPAREN ||
+               g_current_token.type == TOKEN_IDENTIFIER ||
+               g_current_token.type == TOKEN_NUMBER ||
+               g_current_token.type == TOKEN_LTD) {
+        node = parse_node(NODE_EXPR_STMT);
+        Node* value = expression();
+        if (node) node->left = value;
+        eat(TOKEN_SEMICOLON, "Expected ';' after expression statement");
+    } else {
+        error_at_current_token("Invalid start of a statement. Expected 'if', 'while', or an expression.");
+    }
+    TRACE("Finished parsing <statement>.\n");
+    return node;
+}
+
+// <if-statement> -> "if" "(" <condition> ")" <block> [ "else" <block> ]
+static Node* if_statement() {
+    TRACE("Parsing <if-statement>...\n");
+    Node* node = parse_node(NODE_IF);
+    eat(TOKEN_IF, "Expected 'if' keyword");
+    eat(TOKEN_LPAREN, "Expected '(' after 'if'");
+    enter_nesting();
+    Node* test = condition();
+    eat(TOKEN_RPAREN, "Expected ')' after if-condition");
+    leave_nesting();
+    Node* then_block = block();
+    Node* else_block = NULL;
+    if (g_current_token.type == TOKEN_ELSE) {
+        eat(TOKEN_ELSE, "Expected 'else' keyword");
+        else_block = block();
+    }
+    if (node) {
+        node->left = test;
+        node->right = then_block;
+        node->extra = else_block;
+    }
+    TRACE("Finished parsing <if-statement>.\n");
+    return node;
+}
+
+// <while-statement> -> "while" "(" <condition> ")" <block>
+static Node* while_statement() {
+    TRACE("Parsing <while-statement>...\n");
+    Node* node = parse_node(NODE_WHILE);
+    eat(TOKEN_WHILE, "Expected 'while' keyword");
+    eat(TOKEN_LPAREN, "Expected '(' after 'while'");
+    enter_nesting();
+    Node* test = condition();
+    eat(TOKEN_RPAREN, "Expected ')' after while-condition");
+    leave_nesting();
+    Node* body = block();
+    if (node) {
+        node->left = test;
+        node->right = body;
+    }
+    TRACE("Finished parsing <while-statement>.\n");
+    return node;
+}
+
+// <condition> -> <expression> <relational-operator> <expression>
+static Node* condition() {
+    TRACE("Parsing <condition>...\n");
+    Node* left = expression();
+    Node* node = parse_binary_node(NODE_CONDITION, left);
+    relational_operator();
+    Node* right = expression();
+    if (node) node->right = right;
+    node = intern_node(node);
+    TRACE("Finished parsing <condition>.\n");
+    return node;
+}
+
+// <relational-operator> -> "==" | "!=" | "<" | ">" | "<=" | ">="
+static TokenType relational_operator() {
+    TokenType op = g_current_token.type;
+    TRACE("Parsing <relational-operator> (current token: %s)...\n", g_current_token.value);
+    switch (g_current_token.type) {
+        case TOKEN_EQ:
+        case TOKEN_NEQ:
+        case TOKEN_LT:
+        case TOKEN_GT:
+        case TOKEN_LTE:
+        case TOKEN_GTE:
+            TRACE("Recognized relational operator: %s\n", g_current_token.value);
+            advance(); // Consume the operator
+            break;
+        default:
+            error_at_current_token("Expected a relational operator (e.g., ==, <, >=)");
+    }
+    TRACE("Finished parsing <relational-operator>.\n");
+    return op;
+}
+
+// <expression> -> <term> { ("+" | "-") <term> }
+static Node* expression() {
+    TRACE("Parsing <expression>...\n");
+    Node* node = term();
+    while (g_current_token.type == TOKEN_PLUS || g_current_token.type == TOKEN_MINUS) {
+        TRACE("Recognized operator in expression: %s\n", g_current_token.value);
+        node = parse_binary_node(NODE_BINARY, node);
+        advance(); // Consume '+' or '-'
+        Node* right = term();
+        if (node) node->right = right;
+        node = intern_node(node);
+    }
+    TRACE("Finished parsing <expression>.\n");
+    return node;
+}
+
+// <term> -> <factor> { ("*" | "/") <factor> }
+static Node* term() {
+    TRACE("Parsing <term>...\n");
+    Node* node = factor();
+    while (g_current_token.type == TOKEN_MULTIPLY || g_current_token.type == TOKEN_DIVIDE) {
+        TRACE("Recognized operator in term: %s\n", g_current_token.value);
+        node = parse_binary_node(NODE_BINARY, node);
+        advance(); // Consume '*' or '/'
+        Node* right = factor();
+        if (node) node->right = right;
+        node = intern_node(node);
+    }
+    TRACE("Finished parsing <term>.\n");
+    return node;
+}
+
+// <factor> -> <number> | <identifier> | "LTD" | "(" <expression> ")"
+static Node* factor() {
+    Node* node = NULL;
+    TRACE("Parsing <factor> (current token type: %s, value: '%s')...\n", token_type_to_string(g_current_token.type), g_current_token.value);
+    if (g_current_token.type == TOKEN_NUMBER) {
+        TRACE("Recognized number: %s\n", g_current_token.value);
+        node = parse_node(NODE_NUMBER);
+        if (node) node->value = atoi(g_current_token.value);
+        node = intern_node(node);
+        eat(TOKEN_NUMBER, "Error processing number in factor."); // eat already advances
+    } else if (g_current_token.type == TOKEN_IDENTIFIER) {
+        TRACE("Recognized identifier: %s\n", g_current_token.value);
+        node = parse_node(NODE_IDENTIFIER);
+        if (node) node->value = get_symbol_index(g_current_token.value);
+        node = intern_node(node);
+        eat(TOKEN_IDENTIFIER, "Error processing identifier in factor.");
+    } else if (g_current_token.type == TOKEN_LTD) {
+        TRACE("Recognized LTD, substituting with value: %d\n", g_ltd_value);
+        node = intern_node(parse_node(NODE_LTD));
+        eat(TOKEN_LTD, "Error processing LTD in factor.");
+    } else if (g_current_token.type == TOKEN_LPAREN) {
+        eat(TOKEN_LPAREN, "Expected '(' for sub-expression in factor");
+        enter_nesting();
+        node = expression();
+        eat(TOKEN_RPAREN, "Expected ')' after sub-expression in factor");
+        leave_nesting();
+    } else {
+        char error_msg[200];
+        sprintf(error_msg, "Invalid factor. Expected number, identifier, LTD, or '('. Got token type %s ('%s')",
+                token_type_to_string(g_current_token.type), g_current_token.value);
+        error_at_current_token(error_msg);
+    }
+    TRACE("Finished parsing <factor>.\n");
+    return node;
+}
+
+// =============2. Recursive Descent Parser============== end
+
+
+// --- Initialization and Main Driver ---
+static void initialize_parser(const char* source_code) {
+    g_source_code = source_code;
+    g_source_ptr = source_code;
+    g_current_line = 1;
+    g_current_col = 1;
+    g_start_col_for_token = 1;
+    free_symbol_table(); // Normally already released by whoever built the last tree
+    g_token_count = 0;
+    g_nesting = 0;
+    memset(&g_current_token, 0, sizeof(g_current_token)); // No stale token in errors raised before the first one
+    
+    // Load the first token to prime the parser
+    advance();
+}
+
+// Primes the parser at an arbitrary position inside source_code, whose line and
+// column the caller already knows (used to parse a range on a worker thread).
+static void initialize_parser_at(const char* source_code, const char* start, int line, int col) {
+    g_source_code = source_code;
+    g_source_ptr = start;
+    g_current_line = line;
+    g_current_col = col;
+    g_start_col_for_token = col;
+    g_token_count = 0;
+    
+    advance();
+}
+
+// =============8. Structural Pre-filter============== start
+// Classifies the input 64 bytes at a time so that files with unbalanced brackets,
+// unclosed block comments or characters outside the lexer's alphabet are rejected
+// before any parsing. The offsets of '{', '}', '(', ')' and ';' outside comments are
+// kept in a structural index that the parallel splitter reuses.
+
+// Counts the newlines in [p, end); *line_start is moved past the last one found.
+static long count_newlines(const char* p, const char* end, const char** line_start) {
+    long count = 0;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), newline));
+        if (mask != 0) {
+            count += __builtin_popcount(mask);
+            *line_start = p + (31 - __builtin_clz(mask)) + 1;
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == '\n') {
+            count++;
+            *line_start = p + 1;
+        }
+    }
+    return count;
+}
+
+// Returns the byte after the "*/" closing a block comment whose body starts at p,
+// or NULL if the comment is never closed.
+static const char* find_comment_end(const char* p, const char* end) {
+    while (p < end) {
+        const char* star = memchr(p, '*', end - p);
+        if (star == NULL || star + 1 >= end) {
+            return NULL;
+        }
+        if (star[1] == '/') {
+            return star + 2;
+        }
+        p = star + 1;
+    }
+    return NULL;
+}
+
+typedef struct {
+    uint32_t *offsets; // Byte offsets of structural characters in source order (NULL if not built)
+    size_t count;
+    size_t capacity;
+} StructuralIndex;
+
+static void free_structural_index(StructuralIndex* index) {
+    parser_free(index->offsets, index->capacity * sizeof(uint32_t));
+    index->offsets = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
+// Bytes that never need a second look: letters, digits, '_', whitespace and the
+// operators + - * < > = !. Everything else sets a bit in the block mask.
+static int is_plain_char(unsigned char c) {
+    return isalnum(c) || c == '_' || isspace(c) ||
+           c == '+' || c == '-' || c == '*' || c == '<' || c == '>' || c == '=' || c == '!';
+}
+
+#if defined(__SSE2__)
+// Unsigned lo <= c <= hi for every byte of c
+static __m128i bytes_in_range(__m128i c, char lo, char hi) {
+    __m128i offset = _mm_sub_epi8(c, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8((char)(hi - lo))), offset);
+}
+
+static unsigned classify_16(const char* p) {
+    __m128i c = _mm_loadu_si128((const __m128i*)p);
+    __m128i plain = _mm_or_si128(bytes_in_range(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z'),
+                                 bytes_in_range(c, '0', '9'));
+    plain = _mm_or_si128(plain, bytes_in_range(c, '\t', '\r'));
+    plain = _mm_or_si128(plain, bytes_in_range(c, '<', '>'));
+    plain = _mm_or_si128(plain, bytes_in_range(c, '*', '+'));
+    plain = _mm_or_si128(plain, _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+    plain = _mm_or_si128(plain, _mm_cmpeq_epi8(c, _mm_set1_epi8(' ')));
+    plain = _mm_or_si128(plain, _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+    plain = _mm_or_si128(plain, _mm_cmpeq_epi8(c, _mm_set1_epi8('!')));
+    return ~(unsigned)_mm_movemask_epi8(plain) & 0xFFFFu;
+}
+#endif
+
+// One bit per byte of p[0..length-1] (length <= 64) that is not a plain character
+static uint64_t classify_block(const char* p, size_t length) {
+    uint64_t mask = 0;
+#if defined(__SSE2__)
+    if (length == 64) {
+        return (uint64_t)classify_16(p) | (uint64_t)classify_16(p + 16) << 16 |
+               (uint64_t)classify_16(p + 32) << 32 | (uint64_t)classify_16(p + 48) << 48;
+    }
+#endif
+    for (size_t i = 0; i < length; i++) {
+        if (!is_plain_char((unsigned char)p[i])) {
+            mask |= (uint64_t)1 << i;
+        }
+    }
+    return mask;
+}
+
+static void prefilter_error(const char* source, const char* at, TokenType type, const char* value,
+                            const char* message, ParseError* error) {
+    const char* line_start = source;
+    long line = 1 + count_newlines(source, at, &line_start);
+
+    error->kind = "Syntax";
+    snprintf(error->message, sizeof(error->message), "%s", message);
+    error->token = make_token(type, value, (int)line, (int)(at - line_start) + 1);
+    error->source_code = source;
+    error->source_ptr = at;
+}
+
+// Counts a structural character in *count, and records it in index if one is being built
+static void index_structural_char(StructuralIndex* index, size_t* count, const char* source, const char* at) {
+    (*count)++;
+    if (index == NULL || index->offsets == NULL) {
+        return;
+    }
+    if (index->count == index->capacity) {
+        uint32_t* grown = (uint32_t*)parser_realloc(index->offsets, index->capacity * sizeof(uint32_t),
+                                                    index->capacity * 2 * sizeof(uint32_t));
+        if (!grown) {
+            free_structural_index(index); // Parsing works without the index, just slower
+            return;
+        }
+        index->offsets = grown;
+        index->capacity *= 2;
+    }
+    index->offsets[index->count++] = (uint32_t)(at - source);
+}
+
+// Checks the bracket structure, comments and alphabet of source. Returns 1 if the
+// input may be a valid program, 0 if it certainly is not (with the reason in *error).
+// *structural receives the number of structural characters it passed. If index is
+// not NULL, it also receives their offsets (inputs under 4 GB only).
+static int prefilter_source(const char* source, StructuralIndex* index, size_t* structural, ParseError* error) {
+    size_t length = strlen(source);
+    const char* end = source + length;
+    const char* p = source;
+    const char** open = NULL; // Unclosed '{' and '(' characters, innermost last
+    size_t depth = 0;
+    size_t open_capacity = 0;
+    int ok = 0;
+
+    *structural = 0;
+    if (index != NULL) {
+        index->count = 0;
+        index->capacity = length / 8 + 16;
+        index->offsets = length < UINT32_MAX ? (uint32_t*)parser_alloc(index->capacity * sizeof(uint32_t)) : NULL;
+    }
+
+    while (p < end) {
+        size_t span = end - p < 64 ? (size_t)(end - p) : 64;
+        uint64_t mask = classify_block(p, span);
+        const char* resume = NULL; // Set when a comment moves the scan past this block's bits
+
+        while (mask != 0 && resume == NULL) {
+            const char* c = p + __builtin_ctzll(mask);
+            mask &= mask - 1;
+
+            switch (*c) {
+                case '{':
+                case '(':
+                    if (depth == open_capacity) {
+                        size_t capacity = open_capacity ? open_capacity * 2 : 64;
+                        const char** grown = (const char**)parser_realloc(open, open_capacity * sizeof(*open),
+                                                                          capacity * sizeof(*open));
+                        if (!grown) {
+                            prefilter_error(source, c, TOKEN_ERROR, "", "Memory allocation failed for bracket stack", error);
+                            error->kind = "Memory";
+                            goto done;
+                        }
+                        open = grown;
+                        open_capacity = capacity;
+                    }
+                    open[depth++] = c;
+                    index_structural_char(index, structural, source, c);
+                    break;
+                case '}':
+                case ')': {
+                    char expected = *c == '}' ? '{' : '(';
+                    TokenType type = *c == '}' ? TOKEN_RBRACE : TOKEN_RPAREN;
+                    char value[2] = {*c, '\0'};
+                    char message[100];
+                    if (depth == 0) {
+                        sprintf(message, "Unbalanced '%c': no matching '%c'", *c, expected);
+                        prefilter_error(source, c, type, value, message, error);
+                        goto done;
+                    }
+                    if (*open[depth - 1] != expected) {
+                        sprintf(message, "Mismatched '%c': the innermost open bracket is '%c'", *c, *open[depth - 1]);
+                        prefilter_error(source, c, type, value, message, error);
+                        goto done;
+                    }
+                    depth--;
+                    index_structural_char(index, structural, source, c);
+                    break;
+                }
+                case ';':
+                    index_structural_char(index, structural, source, c);
+                    break;
+                case '/':
+                    if (c[1] == '*') {
+                        resume = find_comment_end(c + 2, end);
+                        if (resume == NULL) {
+                            prefilter_error(source, c, TOKEN_ERROR, "/*", "Unclosed comment detected", error);
+                            goto done;
+                        }
+                    } else if (c[1] == '/') {
+                        resume = memchr(c, '\n', end - c);
+                        if (resume == NULL) resume = end;
+                    }
+                    break; // Otherwise a division
+                default: {
+                    char value[2] = {*c, '\0'};
+                    char message[100];
+                    sprintf(message, "Lexical error: Unrecognized character '%c'", *c);
+                    prefilter_error(source, c, TOKEN_ERROR, value, message, error);
+                    goto done;
+                }
+            }
+        }
+        p = resume != NULL ? resume : p + span;
+    }
+
+    if (depth > 0) {
+        const char* c = open[depth - 1];
+        char value[2] = {*c, '\0'};
+        char message[100];
+        sprintf(message, "Unbalanced '%c': no matching '%c'", *c, *c == '{' ? '}' : ')');
+        prefilter_error(source, c, *c == '{' ? TOKEN_LBRACE : TOKEN_LPAREN, value, message, error);
+        goto done;
+    }
+    ok = 1;
+
+done:
+    parser_free(open, open_capacity * sizeof(*open));
+    if (!ok && index != NULL) {
+        free_structural_index(index);
+    }
+    return ok;
+}
+
+// =============8. Structural Pre-filter============== end
+
+// =============6. Parallel Parsing============== start
+
+#define PARALLEL_MAX_THREADS 64
+#define PARALLEL_MIN_RANGE_BYTES (64 * 1024) // Smaller ranges are not worth a thread
+
+// A run of top-level statements of the outermost block, parsed by one thread.
+typedef struct {
+    const char *source; // Whole program
+    const char *begin;  // Where the worker starts lexing (just after a statement boundary)
+    const char *end;    // Statements starting at or after end belong to the next range (NULL for the last range)
+    int line;           // Lexer line of begin
+    int col;            // Lexer column of begin
+    int is_first;       // The first range also consumes the opening '{'
+    const char *first;  // Start of the first token the worker lexed
+    const char *stop;   // Start of the token the worker stopped at
+    int failed;
+    ParseError error;
+    long tokens;        // Tokens the worker scanned, including the one at stop
+    const Limits *limits; // The caller's limits; token limits apply to each range
+} ParseRange;
+
+// Returns the first '{', '}', ';' or '/' in [p, end), or end if there is none.
+static const char* next_structural_char(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i lbrace = _mm_set1_epi8('{');
+    const __m128i rbrace = _mm_set1_epi8('}');
+    const __m128i semicolon = _mm_set1_epi8(';');
+    const __m128i slash = _mm_set1_epi8('/');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lbrace), _mm_cmpeq_epi8(chunk, rbrace)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, semicolon), _mm_cmpeq_epi8(chunk, slash)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '{' && *p != '}' && *p != ';' && *p != '/') {
+        p++;
+    }
+    return p;
+}
+
+// Skips whitespace and comments like skip_whitespace_and_comments(), without
+// touching the lexer state. Returns NULL for an unclosed block comment.
+static const char* skip_blank(const char* p, const char* end) {
+    while (p < end) {
+        if (isspace((unsigned char)*p)) {
+            p++;
+        } else if (*p == '/' && p + 1 < end && p[1] == '*') {
+            p = find_comment_end(p + 2, end);
+            if (p == NULL) {
+                return NULL;
+            }
+        } else if (*p == '/' && p + 1 < end && p[1] == '/') {
+            const char* newline = memchr(p, '\n', end - p);
+            p = newline ? newline : end;
+        } else {
+            break;
+        }
+    }
+    return p;
+}
+
+// Pre-pass that finds up to max_splits statement boundaries of the outermost block,
+// spread evenly by byte offset. A boundary is the byte after a top-level ';', or
+// after a top-level '}' that is not followed by "else". Only brackets and comments
+// are understood here; the workers re-check every boundary while parsing. With a
+// structural index from prefilter_source() the scan jumps from entry to entry.
+static int find_statement_boundaries(const char* source, const char* end, const StructuralIndex* index,
+                                     const char** splits, int max_splits) {
+    size_t length = end - source;
+    size_t next_entry = 0;
+    int depth = 0;
+    int count = 0;
+
+    const char* p = skip_blank(source, end);
+    if (p == NULL || p == end || *p != '{') {
+        return 0;
+    }
+
+    while (count < max_splits) {
+        if (index != NULL) {
+            if (next_entry == index->count) {
+                break;
+            }
+            p = source + index->offsets[next_entry++];
+        } else {
+            p = next_structural_char(p, end);
+            if (p == end) {
+                break;
+            }
+        }
+
+        char c = *p++;
+        if (c == '/') {
+            if (p < end && *p == '*') {
+                p = find_comment_end(p + 1, end);
+                if (p == NULL) {
+                    break; // Unclosed comment: leave it to the parser to report
+                }
+            } else if (p < end && *p == '/') {
+                const char* newline = memchr(p, '\n', end - p);
+                p = newline ? newline : end;
+            }
+            continue;
+        }
+        if (c == '{') {
+            depth++;
+            continue;
+        }
+        if (c == '(' || c == ')') {
+            continue; // Only indexed, never a boundary
+        }
+        if (c == '}') {
+            if (--depth <= 0) {
+                break; // End of the outermost block
+            }
+            if (depth != 1) {
+                continue;
+            }
+            const char* next = skip_blank(p, end);
+            if (next == NULL) {
+                break;
+            }
+            if (end - next >= 4 && memcmp(next, "else", 4) == 0 &&
+                (next + 4 == end || !(isalnum((unsigned char)next[4]) || next[4] == '_'))) {
+                continue; // The if-statement goes on with its else block
+            }
+        } else if (depth != 1) { // ';' inside a nested block
+            continue;
+        }
+
+        if ((size_t)(p - source) >= length * (count + 1) / (max_splits + 1)) {
+            splits[count++] = p;
+        }
+    }
+    return count;
+}
+
+static void* parse_range_worker(void* arg) {
+    ParseRange* range = (ParseRange*)arg;
+    jmp_buf env;
+
+    g_error_jmp = &env;
+    g_token_start = NULL;
+    g_limits = range->limits;
+    g_nesting = range->is_first ? 0 : 1; // Later ranges start inside the outermost block
+    if (setjmp(env) == 0) {
+        initialize_parser_at(range->source, range->begin, range->line, range->col);
+        range->first = g_token_start;
+        if (range->is_first) {
+            eat(TOKEN_LBRACE, "Expected '{' to start a block");
+            enter_nesting();
+        }
+        block_statements(range->end);
+        if (range->end == NULL) {
+            // The last range finishes <block> and <program>
+            eat(TOKEN_RBRACE, "Expected '}' to end a block");
+            if (g_current_token.type != TOKEN_EOF) {
+                error_at_current_token("Expected end of input (EOF) after program block, but found more tokens.");
+            }
+        }
+        range->stop = g_token_start;
+    } else {
+        if (range->first == NULL) {
+            range->first = g_token_start; // The range's first token did not scan
+        }
+        range->failed = 1;
+        range->error = g_last_error;
+    }
+    range->tokens = g_token_count;
+    g_error_jmp = NULL;
+    return NULL;
+}
+
+// Parses a whole program on the calling thread without exiting on errors. If arena
+// is not NULL, the syntax tree is built in it and stored in *tree.
+// Returns 1 on success, 0 if a syntax error was stored in *error.
+static int parse_program_sequential(const char* source, Arena* arena, Node** tree, ParseError* error) {
+    jmp_buf env;
+    int ok = 1;
+
+    g_error_jmp = &env;
+    g_ast_arena = arena;
+    if (setjmp(env) == 0) {
+        initialize_parser(source);
+        Node* root = program();
+        if (tree) *tree = root;
+    } else {
+        ok = 0;
+        *error = g_last_error;
+    }
+    g_ast_arena = NULL;
+    g_error_jmp = NULL;
+    return ok;
+}
+
+// Parses a program by splitting its outermost block into ranges of statements that
+// are parsed on separate threads. The result and the reported error (with its global
+// line and column) are the same as for program(). Returns 1 on success, 0 if a syntax
+// error was stored in *error; *range_count receives the number of ranges used.
+// index may be NULL, or the structural index prefilter_source() built for source.
+static int parse_program_parallel(const char* source, const StructuralIndex* index, int thread_count,
+                                  ParseError* error, int* range_count) {
+    ParseRange ranges[PARALLEL_MAX_THREADS];
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    int started[PARALLEL_MAX_THREADS];
+    const char* splits[PARALLEL_MAX_THREADS];
+    const char* end = source + strlen(source);
+    size_t max_ranges = (size_t)(end - source) / PARALLEL_MIN_RANGE_BYTES;
+    int count = thread_count;
+    int ok = 1;
+
+    if (count > PARALLEL_MAX_THREADS) count = PARALLEL_MAX_THREADS;
+    if ((size_t)count > max_ranges) count = (int)max_ranges;
+    if (index != NULL && index->offsets == NULL) index = NULL; // Index was not built
+    count = count > 1 ? find_statement_boundaries(source, end, index, splits, count - 1) + 1 : 1;
+
+    FILE* saved_trace = g_trace_stream;
+    g_trace_stream = NULL; // Interleaved traces from several threads would be useless
+
+    if (count == 1) {
+        ok = parse_program_sequential(source, NULL, NULL, error);
+        g_trace_stream = saved_trace;
+        *range_count = 1;
+        return ok;
+    }
+
+    // Lay out the ranges, tracking the line and column of each split point
+    const char* line_start = source;
+    const char* counted = source;
+    long line = 1;
+    for (int i = 0; i < count; i++) {
+        ParseRange* range = &ranges[i];
+        memset(range, 0, sizeof(*range));
+        range->source = source;
+        range->begin = i == 0 ? source : splits[i - 1];
+        range->end = i == count - 1 ? NULL : splits[i];
+        line += count_newlines(counted, range->begin, &line_start);
+        counted = range->begin;
+        range->line = (int)line;
+        range->col = (int)(range->begin - line_start) + 1;
+        range->is_first = i == 0;
+        range->limits = g_limits;
+    }
+
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, parse_range_worker, &ranges[i]) == 0;
+        if (!started[i]) {
+            parse_range_worker(&ranges[i]);
+        }
+    }
+    parse_range_worker(&ranges[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // Stitch: the first failing range holds the program's first error, provided every
+    // range before it ended exactly where the next one began. Each range also scanned
+    // the first token of the next one, so that token is counted once.
+    long tokens = 0;
+    for (int i = 0; i < count; i++) {
+        tokens += ranges[i].tokens - (i > 0);
+        g_token_count = tokens;
+        if (ranges[i].failed) {
+            *error = ranges[i].error;
+            ok = 0;
+            break;
+        }
+        if (i + 1 < count && ranges[i].stop != ranges[i + 1].first) {
+            // A split point was not a real statement boundary (only possible for
+            // malformed input); parse sequentially to get the exact diagnostic.
+            ok = parse_program_sequential(source, NULL, NULL, error);
+            count = 1;
+            break;
+        }
+    }
+
+    g_trace_stream = saved_trace;
+    *range_count = count;
+    return ok;
+}
+
+// =============6. Parallel Parsing============== end
+
+// =============15. Pipelined Lexer============== start
+// A lexer thread scans ahead of the parser and hands tokens over through a bounded
+// single-producer/single-consumer ring. Each side owns one index on its own cache line
+// and keeps a cached copy of the other's, so it only touches the shared line when the
+// ring looks full (lexer) or empty (parser). A full ring makes the lexer wait, which
+// bounds the memory in flight to PIPELINE_RING_SLOTS tokens.
+
+#define PIPELINE_RING_SLOTS 1024 // Power of two
+#define PIPELINE_SPINS 256       // Busy-wait rounds before a waiting side yields its core
+#define CACHE_LINE_SIZE 64
+
+typedef struct {
+    Token token;
+    const char *start;    // Lexer position before and after the token
+    const char *end;
+    int unclosed_comment; // The lexer stopped at an unclosed comment instead
+} RingSlot;
+
+typedef struct TokenRing {
+    // Lexer side
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head; // Slots published so far
+    size_t cached_tail;
+    long lexer_stalls;
+    long long lexer_stall_ns;
+
+    // Parser side
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail; // Slots consumed so far
+    size_t cached_head;
+    long parser_stalls;
+    long long parser_stall_ns;
+
+    _Alignas(CACHE_LINE_SIZE) atomic_int cancelled; // The parser stopped early
+    int spins;            // Busy-wait rounds before yielding (none on a single core)
+    RingSlot *slots;
+    const char *source;
+} TokenRing;
+
+static void ring_pause(const TokenRing* ring, int* spins) {
+    if (++*spins < ring->spins) {
+#if defined(__SSE2__)
+        _mm_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+// Waits until the slot at head is free. Returns 0 if the parser gave up instead.
+static int ring_wait_for_space(TokenRing* ring, size_t head) {
+    if (head - ring->cached_tail < PIPELINE_RING_SLOTS) {
+        return 1;
+    }
+    ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - ring->cached_tail < PIPELINE_RING_SLOTS) {
+        return 1;
+    }
+
+    long long start = monotonic_ns();
+    int spins = 0;
+    int ok = 1;
+    while (head - ring->cached_tail >= PIPELINE_RING_SLOTS) {
+        if (atomic_load_explicit(&ring->cancelled, memory_order_relaxed)) {
+            ok = 0;
+            break;
+        }
+        ring_pause(ring, &spins);
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    }
+    ring->lexer_stalls++;
+    ring->lexer_stall_ns += monotonic_ns() - start;
+    return ok;
+}
+
+static void* lexer_thread(void* arg) {
+    TokenRing* ring = (TokenRing*)arg;
+    jmp_buf env;
+
+    g_source_code = ring->source;
+    g_source_ptr = ring->source;
+    g_current_line = 1;
+    g_current_col = 1;
+    g_error_jmp = &env;
+    if (setjmp(env) != 0) {
+        // Unclosed comment: the slot that was being filled reports it
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        RingSlot* slot = &ring->slots[head & (PIPELINE_RING_SLOTS - 1)];
+        slot->unclosed_comment = 1;
+        slot->end = g_source_ptr;
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        g_error_jmp = NULL;
+        return NULL;
+    }
+
+    for (size_t head = 0;; head++) {
+        if (!ring_wait_for_space(ring, head)) {
+            break;
+        }
+        RingSlot* slot = &ring->slots[head & (PIPELINE_RING_SLOTS - 1)];
+        slot->unclosed_comment = 0;
+        slot->token = lexer_get_next_token_internal();
+        slot->start = g_token_start;
+        slot->end = g_source_ptr;
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        if (slot->token.type == TOKEN_EOF || slot->token.type == TOKEN_ERROR) {
+            break; // The parser stops at either
+        }
+    }
+    g_error_jmp = NULL;
+    return NULL;
+}
+
+// advance() in pipelined mode: the next token, with the lexer position the
+// sequential lexer would have had, so errors come out the same
+static void ring_next_token(TokenRing* ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == ring->cached_head) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == ring->cached_head) {
+            long long start = monotonic_ns();
+            int spins = 0;
+            do {
+                ring_pause(ring, &spins);
+                ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            } while (tail == ring->cached_head);
+            ring->parser_stalls++;
+            ring->parser_stall_ns += monotonic_ns() - start;
+        }
+    }
+
+    const RingSlot* slot = &ring->slots[tail & (PIPELINE_RING_SLOTS - 1)];
+    g_source_ptr = slot->end;
+    if (slot->unclosed_comment) {
+        error_at_current_token("Unclosed comment detected");
+    }
+    g_current_token = slot->token;
+    g_token_start = slot->start;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Starts a lexer thread for source. Returns 0 (and the parser lexes on its own) if
+// there is no memory or thread for it.
+static int start_pipeline(TokenRing* ring, const char* source, pthread_t* thread) {
+    memset(ring, 0, sizeof(*ring));
+    ring->source = source;
+    ring->spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? PIPELINE_SPINS : 0;
+    ring->slots = (RingSlot*)parser_alloc(PIPELINE_RING_SLOTS * sizeof(RingSlot));
+    if (ring->slots == NULL) {
+        return 0;
+    }
+    if (pthread_create(thread, NULL, lexer_thread, ring) != 0) {
+        parser_free(ring->slots, PIPELINE_RING_SLOTS * sizeof(RingSlot));
+        ring->slots = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Stops the lexer thread, which may be waiting on a full ring if the parser failed
+static void stop_pipeline(TokenRing* ring, pthread_t thread) {
+    atomic_store_explicit(&ring->cancelled, 1, memory_order_relaxed);
+    pthread_join(thread, NULL);
+    parser_free(ring->slots, PIPELINE_RING_SLOTS * sizeof(RingSlot));
+    ring->slots = NULL;
+}
+
+// =============15. Pipelined Lexer============== end
+
+// =============7. Validate-Only Engine============== start
+// Recognizes the same language as program() with an explicit state stack instead of
+// recursion, a scanner that never builds Token structs, and no output. On an invalid
+// program it reports the same ParseError that program() would have raised.
+
+// Character classes for the validating scanner (isspace/isalpha/isdigit in the C locale)
+enum { VC_OTHER, VC_SPACE, VC_DIGIT, VC_ALPHA };
+
+static const unsigned char g_validator_char_class[256] = {
+    [' '] = VC_SPACE, ['\t'] = VC_SPACE, ['\n'] = VC_SPACE, ['\v'] = VC_SPACE, ['\f'] = VC_SPACE, ['\r'] = VC_SPACE,
+    ['0' ... '9'] = VC_DIGIT,
+    ['a' ... 'z'] = VC_ALPHA, ['A' ... 'Z'] = VC_ALPHA, ['_'] = VC_ALPHA,
+};
+
+// What to do once the construct on top of the validator stack is complete
+enum {
+    V_PROGRAM,      // Program block closed: expect EOF
+    V_IF_BLOCK,     // If-block closed: optional else block
+    V_NESTED_BLOCK, // Else-block or while-body closed: back in the enclosing block
+    V_STATEMENT,    // Expression statement: expect ';'
+    V_PAREN,        // Parenthesised sub-expression: expect ')'
+    V_IF_LHS,       // Left side of an if-condition: expect a relational operator
+    V_IF_RHS,       // Right side of an if-condition: expect ')'
+    V_WHILE_LHS,
+    V_WHILE_RHS
+};
+
+// What the validator expects at the current token
+enum { VS_BLOCK_OPEN, VS_BLOCK_BODY, VS_FACTOR, VS_AFTER_FACTOR };
+
+typedef struct {
+    const char *source;
+    const char *p;          // Next unread byte
+    const char *line_start; // First byte of the current line
+    int line;
+    TokenType type;         // Current token
+    const char *tok;        // First byte of the current token (NULL before the first one)
+    const char *tok_end;    // Byte after the current token
+    int tok_line;
+    int tok_col;
+    long tokens;            // Tokens scanned so far, counted like g_token_count
+} Validator;
+
+// Rebuilds the Token that the lexer would have produced for the current token.
+static Token validator_token(const Validator* v) {
+    if (v->tok == NULL) {
+        Token none;
+        memset(&none, 0, sizeof(none)); // initialize_parser() clears the token the same way
+        return none;
+    }
+    if (v->type == TOKEN_EOF) {
+        return make_token(TOKEN_EOF, "EOF", v->tok_line, v->tok_col);
+    }
+
+    char value[100];
+    size_t length = (size_t)(v->tok_end - v->tok);
+    if (length > sizeof(value) - 1) length = sizeof(value) - 1;
+    memcpy(value, v->tok, length);
+    value[length] = '\0';
+    return make_token(v->type, value, v->tok_line, v->tok_col);
+}
+
+static void validator_error(const Validator* v, ParseError* error, const char* message) {
+    error->kind = "Syntax";
+    snprintf(error->message, sizeof(error->message), "%s", message);
+    error->token = validator_token(v);
+    error->source_code = v->source;
+    error->source_ptr = v->p;
+}
+
+static void validator_limit_error(const Validator* v, ParseError* error, ParserStatus limit) {
+    char message[128];
+    format_limit_message(message, sizeof(message), limit, limit == PARSER_DEPTH_LIMIT ? g_limits->max_depth :
+                         limit == PARSER_TOKEN_LIMIT ? g_limits->max_tokens : g_limits->max_time_ns);
+    validator_error(v, error, message);
+    error->kind = "Limit";
+    error->limit = limit;
+}
+
+// Same message as eat() for a token of the wrong type
+static void validator_eat_error(const Validator* v, ParseError* error, TokenType expected, const char* message) {
+    Token token = validator_token(v);
+    char full_error_message[256];
+    snprintf(full_error_message, sizeof(full_error_message), "%s. Expected %s, but got %s ('%s').",
+             message, token_type_to_string(expected), token_type_to_string(token.type), token.value);
+    validator_error(v, error, full_error_message);
+}
+
+// Consumes the current token and scans the next one, like advance().
+// Returns 0 (with *error filled in) on a lexical error.
+static int validator_advance(Validator* v, ParseError* error) {
+    const char* p = v->p;
+
+    v->tokens++;
+    if (g_limits) {
+        ParserStatus limit = check_token_limits(g_limits, v->tokens);
+        if (limit != PARSER_OK) {
+            validator_limit_error(v, error, limit);
+            return 0;
+        }
+    }
+
+    // Whitespace and comments
+    for (;;) {
+        unsigned char c = (unsigned char)*p;
+        if (g_validator_char_class[c] == VC_SPACE) {
+            if (c == '\n') {
+                v->line++;
+                v->line_start = p + 1;
+            }
+            p++;
+        } else if (c == '/' && p[1] == '*') {
+            const char* body = p + 2;
+            const char* close = body;
+            while ((close = strchr(close, '*')) != NULL && close[1] != '/') {
+                close++;
+            }
+            if (close == NULL) {
+                // The error is reported at the token being consumed, as in skip_whitespace_and_comments()
+                v->p = body + strlen(body);
+                validator_error(v, error, "Unclosed comment detected");
+                return 0;
+            }
+            v->line += count_newlines(body, close, &v->line_start);
+            p = close + 2;
+        } else if (c == '/' && p[1] == '/') {
+            p += 2;
+            while (*p != '\n' && *p != '\0') {
+                p++;
+            }
+        } else {
+            break;
+        }
+    }
+
+    v->tok = p;
+    v->tok_line = v->line;
+    v->tok_col = (int)(p - v->line_start) + 1;
+
+    char c = *p;
+    switch (c) {
+        case '\0': v->type = TOKEN_EOF; break; // Nothing past the terminator is read
+        case '{': v->type = TOKEN_LBRACE; p++; break;
+        case '}': v->type = TOKEN_RBRACE; p++; break;
+        case '(': v->type = TOKEN_LPAREN; p++; break;
+        case ')': v->type = TOKEN_RPAREN; p++; break;
+        case ';': v->type = TOKEN_SEMICOLON; p++; break;
+        case '+': v->type = TOKEN_PLUS; p++; break;
+        case '-': v->type = TOKEN_MINUS; p++; break;
+        case '*': v->type = TOKEN_MULTIPLY; p++; break;
+        case '/': v->type = TOKEN_DIVIDE; p++; break;
+        case '<': v->type = p[1] == '=' ? TOKEN_LTE : TOKEN_LT; p += p[1] == '=' ? 2 : 1; break;
+        case '>': v->type = p[1] == '=' ? TOKEN_GTE : TOKEN_GT; p += p[1] == '=' ? 2 : 1; break;
+        case '=': v->type = p[1] == '=' ? TOKEN_EQ : TOKEN_ERROR; p += p[1] == '=' ? 2 : 1; break;
+        case '!': v->type = p[1] == '=' ? TOKEN_NEQ : TOKEN_ERROR; p += p[1] == '=' ? 2 : 1; break;
+        default:
+            switch (g_validator_char_class[(unsigned char)c]) {
+                case VC_DIGIT:
+                    v->type = TOKEN_NUMBER;
+                    do p++; while (g_validator_char_class[(unsigned char)*p] == VC_DIGIT);
+                    break;
+                case VC_ALPHA:
+                    v->type = TOKEN_IDENTIFIER;
+                    do p++; while (g_validator_char_class[(unsigned char)*p] >= VC_DIGIT);
+                    switch (p - v->tok) {
+                        case 2: if (memcmp(v->tok, "if", 2) == 0) v->type = TOKEN_IF; break;
+                        case 3: if (memcmp(v->tok, "LTD", 3) == 0) v->type = TOKEN_LTD; break;
+                        case 4: if (memcmp(v->tok, "else", 4) == 0) v->type = TOKEN_ELSE; break;
+                        case 5: if (memcmp(v->tok, "while", 5) == 0) v->type = TOKEN_WHILE; break;
+                    }
+                    break;
+                default:
+                    v->type = TOKEN_ERROR;
+                    p++;
+            }
+    }
+    v->p = p;
+    v->tok_end = p;
+
+    if (v->type == TOKEN_ERROR) {
+        char error_msg[150];
+        sprintf(error_msg, "Lexical error: Unrecognized character '%c'", c);
+        validator_error(v, error, error_msg);
+        return 0;
+    }
+    return 1;
+}
+
+// Validates source without building anything. Returns 1 if it is a valid program,
+// 0 if not (with the error program() would have reported stored in *error).
+// Like the parser, it leaves the number of tokens it scanned in g_token_count.
+static int validate_program(const char* source, ParseError* error) {
+    unsigned char local_stack[256];
+    unsigned char* stack = local_stack;
+    size_t stack_size = sizeof(local_stack);
+    size_t depth = 0;
+    int nesting = 0; // Open '{' and '(', as enter_nesting() counts them
+    int max_nesting = g_limits && g_limits->max_depth ? g_limits->max_depth : INT32_MAX;
+    int state = VS_BLOCK_OPEN;
+    int valid = 0;
+    Validator v;
+
+    v.source = source;
+    v.p = source;
+    v.line_start = source;
+    v.line = 1;
+    v.type = TOKEN_EOF;
+    v.tok = NULL;
+    v.tok_end = NULL;
+    v.tok_line = 0;
+    v.tok_col = 0;
+    v.tokens = 0;
+
+#define V_ADVANCE() do { if (!validator_advance(&v, error)) goto done; } while (0)
+#define V_EXPECT(type_, message_) do { \
+        if (v.type != (type_)) { validator_eat_error(&v, error, (type_), (message_)); goto done; } \
+        V_ADVANCE(); \
+    } while (0)
+#define V_ENTER() do { \
+        if (++nesting > max_nesting) { validator_limit_error(&v, error, PARSER_DEPTH_LIMIT); goto done; } \
+    } while (0)
+
+    V_ADVANCE(); // Load the first token
+    stack[depth++] = V_PROGRAM;
+
+    for (;;) {
+        if (depth == stack_size) {
+            unsigned char* grown = (unsigned char*)parser_alloc(stack_size * 2);
+            if (!grown) {
+                validator_error(&v, error, "Memory allocation failed for validator stack");
+                error->kind = "Memory";
+                goto done;
+            }
+            memcpy(grown, stack, depth);
+            if (stack != local_stack) parser_free(stack, stack_size);
+            stack = grown;
+            stack_size *= 2;
+        }
+
+        switch (state) {
+            case VS_BLOCK_OPEN:
+                V_EXPECT(TOKEN_LBRACE, "Expected '{' to start a block");
+                V_ENTER();
+                state = VS_BLOCK_BODY;
+                break;
+
+            case VS_BLOCK_BODY:
+                switch (v.type) {
+                    case TOKEN_RBRACE:
+                    case TOKEN_EOF:
+                        V_EXPECT(TOKEN_RBRACE, "Expected '}' to end a block");
+                        nesting--;
+                        switch (stack[--depth]) {
+                            case V_PROGRAM:
+                                if (v.type != TOKEN_EOF) {
+                                    validator_error(&v, error, "Expected end of input (EOF) after program block, but found more tokens.");
+                                    goto done;
+                                }
+                                valid = 1;
+                                goto done;
+                            case V_IF_BLOCK:
+                                if (v.type == TOKEN_ELSE) {
+                                    V_ADVANCE();
+                                    stack[depth++] = V_NESTED_BLOCK;
+                                    state = VS_BLOCK_OPEN;
+                                }
+                                break;
+                        }
+                        break;
+                    case TOKEN_IF:
+                        V_ADVANCE();
+                        V_EXPECT(TOKEN_LPAREN, "Expected '(' after 'if'");
+                        V_ENTER();
+                        stack[depth++] = V_IF_LHS;
+                        state = VS_FACTOR;
+                        break;
+                    case TOKEN_WHILE:
+                        V_ADVANCE();
+                        V_EXPECT(TOKEN_LPAREN, "Expected '(' after 'while'");
+                        V_ENTER();
+                        stack[depth++] = V_WHILE_LHS;
+                        state = VS_FACTOR;
+                        break;
+                    case TOKEN_LPAREN:
+                    case TOKEN_IDENTIFIER:
+                    case TOKEN_NUMBER:
+                    case TOKEN_LTD:
+                        stack[depth++] = V_STATEMENT;
+                        state = VS_FACTOR;
+                        break;
+                    default:
+                        validator_error(&v, error, "Invalid token inside block. Expected a statement or '}'.");
+                        goto done;
+                }
+                break;
+
+            case VS_FACTOR:
+                switch (v.type) {
+                    case TOKEN_NUMBER:
+                    case TOKEN_IDENTIFIER:
+                    case TOKEN_LTD:
+                        V_ADVANCE();
+                        state = VS_AFTER_FACTOR;
+                        break;
+                    case TOKEN_LPAREN:
+                        V_ADVANCE();
+                        V_ENTER();
+                        stack[depth++] = V_PAREN;
+                        break;
+                    default: {
+                        Token token = validator_token(&v);
+                        char error_msg[200];
+                        sprintf(error_msg, "Invalid factor. Expected number, identifier, LTD, or '('. Got token type %s ('%s')",
+                                token_type_to_string(token.type), token.value);
+                        validator_error(&v, error, error_msg);
+                        goto done;
+                    }
+                }
+                break;
+
+            case VS_AFTER_FACTOR:
+                if (v.type == TOKEN_PLUS || v.type == TOKEN_MINUS ||
+                    v.type == TOKEN_MULTIPLY || v.type == TOKEN_DIVIDE) {
+                    V_ADVANCE();
+                    state = VS_FACTOR;
+                    break;
+                }
+                // The expression is complete
+                int completed = stack[--depth];
+                switch (completed) {
+                    case V_PAREN:
+                        V_EXPECT(TOKEN_RPAREN, "Expected ')' after sub-expression in factor");
+                        nesting--;
+                        break;
+                    case V_STATEMENT:
+                        V_EXPECT(TOKEN_SEMICOLON, "Expected ';' after expression statement");
+                        state = VS_BLOCK_BODY;
+                        break;
+                    case V_IF_LHS:
+                    case V_WHILE_LHS:
+                        if (v.type < TOKEN_EQ || v.type > TOKEN_GTE) {
+                            validator_error(&v, error, "Expected a relational operator (e.g., ==, <, >=)");
+                            goto done;
+                        }
+                        V_ADVANCE();
+                        stack[depth++] = completed == V_IF_LHS ? V_IF_RHS : V_WHILE_RHS;
+                        state = VS_FACTOR;
+                        break;
+                    case V_IF_RHS:
+                        V_EXPECT(TOKEN_RPAREN, "Expected ')' after if-condition");
+                        nesting--;
+                        stack[depth++] = V_IF_BLOCK;
+                        state = VS_BLOCK_OPEN;
+                        break;
+                    case V_WHILE_RHS:
+                        V_EXPECT(TOKEN_RPAREN, "Expected ')' after while-condition");
+                        nesting--;
+                        stack[depth++] = V_NESTED_BLOCK;
+                        state = VS_BLOCK_OPEN;
+                        break;
+                }
+                break;
+        }
+    }
+
+#undef V_ENTER
+#undef V_EXPECT
+#undef V_ADVANCE
+
+done:
+    if (stack != local_stack) parser_free(stack, stack_size);
+    g_token_count = v.tokens;
+    return valid;
+}
+
+// =============7. Validate-Only Engine============== end
+
+// =============17. Execution Profiler============== start
+// With ParserOptions.profile, run_program() counts every statement, loop iteration and
+// if branch and times every block. Before the run each statement and block gets an
+// entry, numbered in source order; its index is kept in the node's profile_index, so the
+// interpreter finds it without a lookup.
+
+static _Thread_local ParserProfileEntry* g_profile = NULL; // Entries of the run being profiled
+static _Thread_local int g_profile_open = -1;              // Innermost block being executed
+
+// Numbers the blocks and statements from block on, starting at index, and describes
+// them in entries unless it is NULL. Returns the next free index.
+static int number_profile_entries(Node* block, ParserProfileEntry* entries, int index, int parent,
+                                  int owner, int is_else) {
+    int block_index = index++;
+    assert(!(block->flags & NODE_WEIGHTED)); // Shares the field with profile_index
+    block->profile_index = block_index;
+    block->flags |= NODE_PROFILED;
+    if (entries) {
+        ParserProfileEntry* entry = &entries[block_index];
+        memset(entry, 0, sizeof(*entry));
+        entry->kind = PARSER_PROFILE_BLOCK;
+        entry->line = block->line;
+        entry->col = block->col;
+        entry->parent = parent;
+        entry->owner = owner;
+        entry->is_else = is_else;
+    }
+
+    for (Node* statement = block->left; statement != NULL; statement = statement->next) {
+        int statement_index = index++;
+        assert(!(statement->flags & NODE_WEIGHTED));
+        statement->profile_index = statement_index;
+        statement->flags |= NODE_PROFILED;
+        if (entries) {
+            ParserProfileEntry* entry = &entries[statement_index];
+            memset(entry, 0, sizeof(*entry));
+            entry->kind = statement->type == NODE_IF ? PARSER_PROFILE_IF :
+                          statement->type == NODE_WHILE ? PARSER_PROFILE_WHILE : PARSER_PROFILE_EXPRESSION;
+            entry->line = statement->line;
+            entry->col = statement->col;
+            entry->parent = block_index;
+            entry->owner = -1;
+        }
+        if (statement->type == NODE_IF || statement->type == NODE_WHILE) {
+            index = number_profile_entries(statement->right, entries, index, block_index, statement_index, 0);
+        }
+        if (statement->type == NODE_IF && statement->extra != NULL) {
+            index = number_profile_entries(statement->extra, entries, index, block_index, statement_index, 1);
+        }
+    }
+    return index;
+}
+
+// Allocates and numbers the entries of tree into the result. Returns 0 when out of memory.
+static int start_profile(Node* tree, ParserResult* result) {
+    int count = number_profile_entries(tree, NULL, 0, -1, -1, 0);
+    result->profile = (ParserProfileEntry*)parser_alloc(count * sizeof(ParserProfileEntry));
+    if (!result->profile) {
+        return 0;
+    }
+    result->profile_count = count;
+    number_profile_entries(tree, result->profile, 0, -1, -1, 0);
+    g_profile_open = -1;
+    return 1;
+}
+
+// Closes the blocks a runtime error left at end_ns, then works out the self times: a
+// block's time less that of the blocks nested directly in it
+static void finish_profile(ParserResult* result, long long end_ns) {
+    for (int i = g_profile_open; i >= 0; i = result->profile[i].parent) {
+        result->profile[i].ns += end_ns;
+    }
+    g_profile_open = -1;
+    for (int i = 0; i < result->profile_count; i++) {
+        result->profile[i].self_ns = result->profile[i].ns;
+    }
+    for (int i = 0; i < result->profile_count; i++) {
+        const ParserProfileEntry* entry = &result->profile[i];
+        if (entry->kind == PARSER_PROFILE_BLOCK && entry->parent >= 0) {
+            result->profile[entry->parent].self_ns -= entry->ns;
+        }
+    }
+}
+
+// =============17. Execution Profiler============== end
+
+// =============10. Program Interpreter============== start
+// Executes a syntax tree built by program(). Variables live in the symbol table (the
+// grammar has no assignment, so they keep their default of 0) and LTD is g_ltd_value.
+
+#define DEFAULT_MAX_LOOP_ITERATIONS 1000000L // A while loop running longer than this is reported as runaway
+#define EVAL_MIN_TASK_WEIGHT 4096 // Parallel evaluation: least work, in weighted nodes, given a task of its own
+
+static _Thread_local long g_max_loop_iterations = DEFAULT_MAX_LOOP_ITERATIONS; // ParserOptions.max_loop_iterations
+
+typedef struct {
+    long statements;  // Statements executed
+    long operations;  // Arithmetic and relational operations evaluated
+    long iterations;  // While-loop iterations
+    int last_value;   // Value of the last expression statement executed
+    int has_value;    // An expression statement has set last_value
+    long tasks;       // Tasks a parallel evaluation ran
+    long memo_hits;   // Operations answered from a memoized value (expression DAG)
+} ExecStats;
+
+static _Thread_local ExecStats g_exec_stats;
+static _Thread_local int* g_temp_values = NULL; // Values of the temporaries introduced by optimize_program()
+static _Thread_local int g_temp_count = 0;
+static _Thread_local struct EvalPool* g_eval_pool = NULL; // Set while a run evaluates in parallel
+
+static void exec_block(const Node* block);
+static void exec_block_parallel(const Node* block);
+
+// Start of the given line of source, for displaying runtime errors
+static const char* source_line_start(const char* source, int line) {
+    const char* p = source;
+    for (int i = 1; i < line; i++) {
+        const char* newline = strchr(p, '\n');
+        if (newline == NULL) {
+            break;
+        }
+        p = newline + 1;
+    }
+    return p;
+}
+
+static void raise_at_node(const Node* node, const char* kind, const char* message) {
+    g_last_error.kind = kind;
+    snprintf(g_last_error.message, sizeof(g_last_error.message), "%s", message);
+    g_last_error.token = make_token(TOKEN_ERROR, "", node->line, node->col);
+    g_last_error.source_code = g_source_code;
+    g_last_error.source_ptr = source_line_start(g_source_code, node->line);
+    longjmp(*g_error_jmp, 1);
+}
+
+static void runtime_error(const Node* node, const char* message) {
+    raise_at_node(node, "Runtime", message);
+}
+
+static _Thread_local unsigned g_memo_epoch = 0; // Run number; memoized values of older runs are stale
+
+static int eval_node(const Node* node);
+
+static int compute_node(const Node* node) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            return node->value;
+        case NODE_IDENTIFIER:
+            return g_symbol_table[node->value].value;
+        case NODE_LTD:
+            return g_ltd_value;
+        case NODE_TEMP:
+            return g_temp_values[node->value];
+        case NODE_SHIFT_LEFT: {
+            int value = eval_node(node->left);
+            g_exec_stats.operations++;
+            return (int)((unsigned)value << node->value);
+        }
+        case NODE_SHIFT_DIV: {
+            int value = eval_node(node->left);
+            g_exec_stats.operations++;
+            // Negative dividends are biased by 2^k - 1 so that the shift rounds toward zero
+            int bias = value < 0 ? (1 << node->value) - 1 : 0;
+            return (value + bias) >> node->value;
+        }
+        case NODE_BINARY:
+        case NODE_CONDITION: {
+            int left = eval_node(node->left);
+            int right = eval_node(node->right);
+            g_exec_stats.operations++;
+            switch (node->op) {
+                // Through unsigned, so that overflow wraps instead of being undefined
+                case TOKEN_PLUS: return (int)((unsigned)left + (unsigned)right);
+                case TOKEN_MINUS: return (int)((unsigned)left - (unsigned)right);
+                case TOKEN_MULTIPLY: return (int)((unsigned)left * (unsigned)right);
+                case TOKEN_DIVIDE:
+                    if (right == 0) {
+                        runtime_error(node, "Division by zero");
+                    }
+                    // INT_MIN / -1 wraps to INT_MIN like the other operations (the CPU would trap)
+                    return right == -1 ? (int)(0u - (unsigned)left) : left / right;
+                case TOKEN_EQ: return left == right;
+                case TOKEN_NEQ: return left != right;
+                case TOKEN_LT: return left < right;
+                case TOKEN_GT: return left > right;
+                case TOKEN_LTE: return left <= right;
+                case TOKEN_GTE: return left >= right;
+                default: break;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    runtime_error(node, "Invalid node in expression");
+    return 0;
+}
+
+// Variables cannot change during a run, so a DAG node's value is computed once per run
+static int eval_node(const Node* node) {
+    if (!(node->flags & NODE_MEMOIZED)) {
+        return compute_node(node);
+    }
+    Node* memo = (Node*)node;
+    if (memo->memo_epoch == g_memo_epoch) {
+        g_exec_stats.memo_hits++;
+        return memo->memo_value;
+    }
+    memo->memo_value = compute_node(node);
+    memo->memo_epoch = g_memo_epoch;
+    return memo->memo_value;
+}
+
+static void exec_statement(const Node* node) {
+    ParserProfileEntry* profile = g_profile ? &g_profile[node->profile_index] : NULL;
+    g_exec_stats.statements++;
+    if (profile) profile->count++;
+    switch (node->type) {
+        case NODE_EXPR_STMT:
+            g_exec_stats.last_value = eval_node(node->left);
+            g_exec_stats.has_value = 1;
+            break;
+        case NODE_IF:
+            if (eval_node(node->left)) {
+                if (profile) profile->then_taken++;
+                exec_block(node->right);
+            } else {
+                if (profile) profile->else_taken++;
+                if (node->extra != NULL) exec_block(node->extra);
+            }
+            break;
+        case NODE_WHILE: {
+            // Pre-header: what the condition needs is computed before the first test,
+            // what only the body needs at the start of the first iteration
+            const Node* hoist = node->extra;
+            for (int i = 0; i < node->value; i++, hoist = hoist->next) {
+                g_temp_values[hoist->value] = eval_node(hoist->left);
+            }
+            long iterations = 0;
+            while (eval_node(node->left)) {
+                if (++iterations > g_max_loop_iterations) {
+                    runtime_error(node, "Loop iteration limit exceeded (runaway while loop)");
+                }
+                if (g_limits && g_limits->deadline_ns && (iterations & (LIMIT_CHECK_INTERVAL - 1)) == 0 &&
+                    monotonic_ns() > g_limits->deadline_ns) {
+                    char message[128];
+                    format_limit_message(message, sizeof(message), PARSER_TIME_LIMIT, g_limits->max_time_ns);
+                    g_last_error.limit = PARSER_TIME_LIMIT;
+                    raise_at_node(node, "Limit", message);
+                }
+                if (iterations == 1) {
+                    for (; hoist != NULL; hoist = hoist->next) {
+                        g_temp_values[hoist->value] = eval_node(hoist->left);
+                    }
+                }
+                g_exec_stats.iterations++;
+                if (profile) profile->iterations++;
+                exec_block(node->right);
+            }
+            break;
+        }
+        default:
+            runtime_error(node, "Invalid node in statement list");
+    }
+}
+
+static void exec_block(const Node* block) {
+    if (g_profile) {
+        // The start time is subtracted now and the end time added on the way out, or
+        // by finish_profile() if a runtime error leaves the block early
+        ParserProfileEntry* profile = &g_profile[block->profile_index];
+        int enclosing = g_profile_open;
+        g_profile_open = block->profile_index;
+        profile->count++;
+        profile->ns -= monotonic_ns();
+        for (const Node* statement = block->left; statement != NULL; statement = statement->next) {
+            exec_statement(statement);
+        }
+        profile->ns += monotonic_ns();
+        g_profile_open = enclosing;
+        return;
+    }
+    if (g_eval_pool && block->weight >= 2 * EVAL_MIN_TASK_WEIGHT) {
+        exec_block_parallel(block);
+        return;
+    }
+    for (const Node* statement = block->left; statement != NULL; statement = statement->next) {
+        exec_statement(statement);
+    }
+}
+
+static struct EvalPool* start_eval_pool(int threads);
+static void stop_eval_pool(struct EvalPool* pool);
+
+// Executes the tree of a parsed program, with statistics in g_exec_stats. With more
+// than one thread (for a tree that went through analyze_dependencies()) large blocks
+// are split into tasks for a pool. Returns 1 on success, 0 if a runtime error was
+// stored in *error.
+static int run_program(const Node* tree, int threads, ParseError* error) {
+    jmp_buf env;
+    volatile int ok = 1; // Kept in memory across the longjmp()
+
+    memset(&g_exec_stats, 0, sizeof(g_exec_stats));
+    if (++g_memo_epoch == 0) g_memo_epoch = 1; // Nodes start out with epoch 0
+    size_t temp_bytes = g_temp_count * sizeof(int);
+    g_temp_values = NULL;
+
+    g_error_jmp = &env;
+    if (setjmp(env) == 0) {
+        if (g_temp_count > 0) {
+            g_temp_values = (int*)parser_alloc(temp_bytes);
+            if (!g_temp_values) {
+                runtime_error(tree, "Memory allocation failed for temporaries");
+            }
+            memset(g_temp_values, 0, temp_bytes);
+        }
+        if (threads > 1) {
+            g_eval_pool = start_eval_pool(threads); // NULL (sequential) if no thread could start
+        }
+        exec_block(tree);
+    } else {
+        ok = 0;
+        *error = g_last_error;
+        if (g_temp_count > 0 && !g_temp_values) error->kind = "Memory";
+    }
+    if (g_eval_pool) {
+        stop_eval_pool(g_eval_pool);
+        g_eval_pool = NULL;
+    }
+    g_error_jmp = NULL;
+    parser_free(g_temp_values, temp_bytes);
+    g_temp_values = NULL;
+    return ok;
+}
+
+// =============10. Program Interpreter============== end
+
+// =============18. Parallel Evaluation============== start
+// Expression statements have no side effects, so the statements of a block can run
+// at the same time unless one of them reads what another writes. Before the run,
+// analyze_dependencies() marks each statement that must wait for the ones before it
+// (NODE_BARRIER) and stores the weight of every statement and block.
+// While running, a block heavy enough is cut at its barriers into segments, and each
+// segment into tasks of similar weight. The pool's threads run the tasks; the thread
+// that forked them runs the first and then helps with queued tasks until all are
+// done, so nested blocks can fork again without tying up a thread. The tasks' results
+// are then combined in source order and stop at the first task that failed, which
+// gives exactly the statistics, value and error of the sequential run.
+
+#define EVAL_MAX_TASKS 64     // Tasks one segment is cut into at most
+#define EVAL_TASKS_PER_THREAD 4 // More tasks than threads evens out their differences
+#define EVAL_LOOP_WEIGHT 16   // Weight of a while loop per node of it, for its iterations
+
+// The temporaries a statement reads and writes, as ranges that may cover more than
+// that (lo > hi: none). Variables are never written, so only temporaries matter.
+typedef struct {
+    int read_lo, read_hi;
+    int write_lo, write_hi;
+} EvalAccess;
+
+static void add_access(int* lo, int* hi, int from, int to) {
+    if (from < *lo) *lo = from;
+    if (to > *hi) *hi = to;
+}
+
+static int ranges_overlap(int lo1, int hi1, int lo2, int hi2) {
+    return lo1 <= hi1 && lo2 <= hi2 && lo1 <= hi2 && lo2 <= hi1;
+}
+
+// Adds the temporaries an expression reads to *access. Returns its node count.
+static long analyze_expression(const Node* node, EvalAccess* access) {
+    if (node == NULL) {
+        return 0;
+    }
+    if (node->type == NODE_TEMP) {
+        add_access(&access->read_lo, &access->read_hi, node->value, node->value);
+    }
+    return 1 + analyze_expression(node->left, access) + analyze_expression(node->right, access);
+}
+
+static long analyze_block(Node* block, EvalAccess* access, int* barriers);
+
+// Returns the weight of a statement and adds what it reads and writes to *access
+static long analyze_statement(Node* statement, EvalAccess* access, int* barriers) {
+    long weight = 1 + analyze_expression(statement->left, access);
+    if (statement->type == NODE_IF) {
+        weight += analyze_block(statement->right, access, barriers);
+        if (statement->extra != NULL) {
+            weight += analyze_block(statement->extra, access, barriers);
+        }
+    } else if (statement->type == NODE_WHILE) {
+        for (const Node* hoist = statement->extra; hoist != NULL; hoist = hoist->next) {
+            add_access(&access->write_lo, &access->write_hi, hoist->value, hoist->value);
+            weight += analyze_expression(hoist->left, access);
+        }
+        weight = (weight + analyze_block(statement->right, access, barriers)) * EVAL_LOOP_WEIGHT;
+    }
+    return weight;
+}
+
+// Marks the barriers of a block and the blocks in it, counting them in *barriers, and
+// stores the weights (capped at INT_MAX). Returns the block's weight and adds what it
+// reads and writes to *access.
+static long analyze_block(Node* block, EvalAccess* access, int* barriers) {
+    EvalAccess segment = {INT_MAX, -1, INT_MAX, -1}; // Statements since the last barrier
+    long weight = 1;
+
+    for (Node* statement = block->left; statement != NULL; statement = statement->next) {
+        EvalAccess own = {INT_MAX, -1, INT_MAX, -1};
+        long statement_weight = analyze_statement(statement, &own, barriers);
+
+        statement->flags &= ~NODE_BARRIER;
+        if (ranges_overlap(own.read_lo, own.read_hi, segment.write_lo, segment.write_hi) ||
+            ranges_overlap(own.write_lo, own.write_hi, segment.read_lo, segment.read_hi) ||
+            ranges_overlap(own.write_lo, own.write_hi, segment.write_lo, segment.write_hi)) {
+            statement->flags |= NODE_BARRIER;
+            segment = own;
+            (*barriers)++;
+        } else {
+            add_access(&segment.read_lo, &segment.read_hi, own.read_lo, own.read_hi);
+            add_access(&segment.write_lo, &segment.write_hi, own.write_lo, own.write_hi);
+        }
+        add_access(&access->read_lo, &access->read_hi, own.read_lo, own.read_hi);
+        add_access(&access->write_lo, &access->write_hi, own.write_lo, own.write_hi);
+        assert(!(statement->flags & NODE_PROFILED)); // Shares the field with weight
+        statement->weight = statement_weight < INT_MAX ? (int)statement_weight : INT_MAX;
+        statement->flags |= NODE_WEIGHTED;
+        weight += statement_weight;
+        if (weight > INT_MAX) weight = INT_MAX;
+    }
+    assert(!(block->flags & NODE_PROFILED));
+    block->weight = (int)weight;
+    block->flags |= NODE_WEIGHTED;
+    return weight;
+}
+
+// Prepares a tree for run_program() on several threads. Returns the number of barriers.
+static int analyze_dependencies(Node* tree) {
+    EvalAccess access = {INT_MAX, -1, INT_MAX, -1};
+    int barriers = 0;
+    analyze_block(tree, &access, &barriers);
+    return barriers;
+}
+
+typedef struct EvalTask {
+    const Node *first;      // Statements [first, end) of one block
+    const Node *end;
+    struct EvalFork *fork;
+    struct EvalTask *next;  // Next in the pool's queue
+    int failed;
+    ExecStats stats;        // What running the statements added
+    ParseError error;
+} EvalTask;
+
+typedef struct EvalFork {
+    int remaining;          // Tasks not finished yet (under the pool's lock)
+} EvalFork;
+
+typedef struct EvalPool {
+    pthread_mutex_t lock;
+    pthread_cond_t task_ready; // A task was queued or the pool is stopping
+    pthread_cond_t task_done;  // A task finished
+    EvalTask *queue;           // Last queued first
+    int stopping;
+    int threads;               // Including the thread that runs the program
+    int started;
+    pthread_t workers[PARALLEL_MAX_THREADS];
+    long tasks;                // Tasks run (under the lock)
+
+    // The running thread's state, which the workers take over
+    const char *source_code;
+    int ltd_value;
+    long max_loop_iterations;
+    const Limits *limits;
+    int *temp_values;
+    const Symbol *symbols;
+    int symbol_count;
+    const ParserAllocator *allocator;
+} EvalPool;
+
+// Runs a task's statements with statistics of its own; a runtime error ends the task
+static void run_eval_task(EvalPool* pool, EvalTask* task) {
+    jmp_buf env;
+    jmp_buf* saved_jmp = g_error_jmp;
+    ExecStats saved_stats = g_exec_stats;
+
+    memset(&g_exec_stats, 0, sizeof(g_exec_stats));
+    g_error_jmp = &env;
+    if (setjmp(env) == 0) {
+        for (const Node* statement = task->first; statement != task->end; statement = statement->next) {
+            exec_statement(statement);
+        }
+    } else {
+        task->failed = 1;
+        task->error = g_last_error;
+    }
+    task->stats = g_exec_stats;
+    g_exec_stats = saved_stats;
+    g_error_jmp = saved_jmp;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->tasks++;
+    if (--task->fork->remaining == 0) {
+        pthread_cond_broadcast(&pool->task_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Takes the most recently queued task; the caller holds the lock
+static EvalTask* take_eval_task(EvalPool* pool) {
+    EvalTask* task = pool->queue;
+    if (task != NULL) {
+        pool->queue = task->next;
+    }
+    return task;
+}
+
+static void* eval_worker(void* arg) {
+    EvalPool* pool = (EvalPool*)arg;
+
+    g_source_code = pool->source_code;
+    g_ltd_value = pool->ltd_value;
+    g_max_loop_iterations = pool->max_loop_iterations;
+    g_limits = pool->limits;
+    g_temp_values = pool->temp_values;
+    g_allocator = pool->allocator;
+    g_symbol_table = (Symbol*)pool->symbols; // Only read while the tree runs
+    g_symbol_count = pool->symbol_count;
+    g_eval_pool = pool; // Blocks inside a task fork too
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        EvalTask* task = take_eval_task(pool);
+        if (task != NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            run_eval_task(pool, task);
+            pthread_mutex_lock(&pool->lock);
+        } else if (pool->stopping) {
+            break;
+        } else {
+            pthread_cond_wait(&pool->task_ready, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Runs statements [first, end) as count tasks cut at the given statements, then adds
+// their results to this thread's as if they had run here in order
+static void fork_eval_tasks(EvalPool* pool, const Node* first, const Node* end, const Node* const* cuts, int count) {
+    EvalFork fork = {count};
+    EvalTask* tasks = (EvalTask*)parser_alloc(count * sizeof(EvalTask));
+    if (tasks == NULL) {
+        for (const Node* statement = first; statement != end; statement = statement->next) {
+            exec_statement(statement);
+        }
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        tasks[i].first = i == 0 ? first : cuts[i - 1];
+        tasks[i].end = i + 1 < count ? cuts[i] : end;
+        tasks[i].fork = &fork;
+        tasks[i].failed = 0;
+    }
+
+    // Queue all but the first, last first, so that the next task is taken first
+    pthread_mutex_lock(&pool->lock);
+    for (int i = count - 1; i >= 1; i--) {
+        tasks[i].next = pool->queue;
+        pool->queue = &tasks[i];
+    }
+    pthread_cond_broadcast(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_eval_task(pool, &tasks[0]);
+    pthread_mutex_lock(&pool->lock);
+    while (fork.remaining > 0) {
+        EvalTask* task = take_eval_task(pool);
+        if (task != NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            run_eval_task(pool, task);
+            pthread_mutex_lock(&pool->lock);
+        } else {
+            pthread_cond_wait(&pool->task_done, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    int failed = -1;
+    for (int i = 0; i < count && failed < 0; i++) {
+        const ExecStats* stats = &tasks[i].stats;
+        g_exec_stats.statements += stats->statements;
+        g_exec_stats.operations += stats->operations;
+        g_exec_stats.iterations += stats->iterations;
+        g_exec_stats.memo_hits += stats->memo_hits;
+        if (stats->has_value) {
+            g_exec_stats.last_value = stats->last_value;
+            g_exec_stats.has_value = 1;
+        }
+        if (tasks[i].failed) failed = i;
+    }
+    if (failed >= 0) {
+        g_last_error = tasks[failed].error;
+    }
+    parser_free(tasks, count * sizeof(EvalTask));
+    if (failed >= 0) {
+        longjmp(*g_error_jmp, 1);
+    }
+}
+
+// Runs a block whose weight makes splitting it worthwhile, one segment at a time
+static void exec_block_parallel(const Node* block) {
+    EvalPool* pool = g_eval_pool;
+    const Node* statement = block->left;
+
+    while (statement != NULL) {
+        // The segment: this statement and the ones up to the next barrier
+        const Node* first = statement;
+        long weight = 0;
+        do {
+            weight += statement->weight;
+            statement = statement->next;
+        } while (statement != NULL && !(statement->flags & NODE_BARRIER));
+
+        long target = weight / (pool->threads * EVAL_TASKS_PER_THREAD);
+        if (target < EVAL_MIN_TASK_WEIGHT) target = EVAL_MIN_TASK_WEIGHT;
+        if (target < weight / EVAL_MAX_TASKS + 1) target = weight / EVAL_MAX_TASKS + 1;
+
+        const Node* cuts[EVAL_MAX_TASKS];
+        int count = 1;
+        long task_weight = 0;
+        for (const Node* s = first; s != statement; s = s->next) {
+            if (task_weight >= target && count < EVAL_MAX_TASKS) {
+                cuts[count - 1] = s;
+                count++;
+                task_weight = 0;
+            }
+            task_weight += s->weight;
+        }
+        if (count == 1) {
+            for (const Node* s = first; s != statement; s = s->next) {
+                exec_statement(s);
+            }
+        } else {
+            fork_eval_tasks(pool, first, statement, cuts, count);
+        }
+    }
+}
+
+// Starts threads - 1 workers. Returns NULL if none could start.
+static EvalPool* start_eval_pool(int threads) {
+    EvalPool* pool = (EvalPool*)parser_alloc(sizeof(EvalPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_ready, NULL);
+    pthread_cond_init(&pool->task_done, NULL);
+    pool->source_code = g_source_code;
+    pool->ltd_value = g_ltd_value;
+    pool->max_loop_iterations = g_max_loop_iterations;
+    pool->limits = g_limits;
+    pool->temp_values = g_temp_values;
+    pool->symbols = g_symbol_table;
+    pool->symbol_count = g_symbol_count;
+    pool->allocator = g_allocator;
+
+    if (threads > PARALLEL_MAX_THREADS) threads = PARALLEL_MAX_THREADS;
+    while (pool->started + 1 < threads &&
+           pthread_create(&pool->workers[pool->started], NULL, eval_worker, pool) == 0) {
+        pool->started++;
+    }
+    pool->threads = pool->started + 1;
+    if (pool->started == 0) {
+        stop_eval_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void stop_eval_pool(EvalPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    g_exec_stats.tasks = pool->tasks;
+    pthread_cond_destroy(&pool->task_done);
+    pthread_cond_destroy(&pool->task_ready);
+    pthread_mutex_destroy(&pool->lock);
+    parser_free(pool, sizeof(EvalPool));
+}
+
+// =============18. Parallel Evaluation============== end
+
+// =============11. Loop Optimizer============== start
+// Hoists loop-invariant subexpressions of while loops into temporaries computed once
+// in a pre-header, and replaces multiplication and division by a power-of-two
+// constant with shifts (NODE_SHIFT_LEFT / NODE_SHIFT_DIV).
+
+typedef struct {
+    const Node *loop;
+    long ops_before;       // Operations per iteration before optimization
+    long ops_after;        // Operations per iteration after optimization
+    int hoisted;           // Subexpressions moved to the pre-header
+    int reduced;           // Multiplications and divisions replaced by shifts
+    Node **pre_header_end; // Where the next NODE_HOIST is linked
+} LoopReport;
+
+typedef struct {
+    LoopReport *loops;     // In source order
+    int loop_count;
+    int loop_capacity;
+    int reduced_outside_loops;
+} OptimizationReport;
+
+static int is_operation(const Node* node) {
+    return node->type == NODE_BINARY || node->type == NODE_CONDITION ||
+           node->type == NODE_SHIFT_LEFT || node->type == NODE_SHIFT_DIV;
+}
+
+// k if node is the literal 2^k with k >= 1, otherwise -1
+static int power_of_two_exponent(const Node* node) {
+    if (node->type != NODE_NUMBER || node->value < 2 || (node->value & (node->value - 1)) != 0) {
+        return -1;
+    }
+    return __builtin_ctz((unsigned)node->value);
+}
+
+// Whether node can be computed once before the loop instead of on every iteration.
+// Nothing in the grammar assigns a variable, so every identifier is loop-invariant;
+// what limits hoisting is that the pre-header computes subexpressions of statements
+// that might never run (an if-branch, or code after a division by zero), so a
+// division that might raise "Division by zero" has to stay where it is.
+// Temporaries belong to inner pre-headers, which run on every outer iteration.
+static int is_hoistable(const Node* node) {
+    switch (node->type) {
+        case NODE_NUMBER:
+        case NODE_IDENTIFIER:
+        case NODE_LTD:
+            return 1;
+        case NODE_SHIFT_LEFT:
+        case NODE_SHIFT_DIV:
+            return is_hoistable(node->left);
+        case NODE_BINARY:
+            if (node->op == TOKEN_DIVIDE && (node->right->type != NODE_NUMBER || node->right->value == 0)) {
+                return 0;
+            }
+            return is_hoistable(node->left) && is_hoistable(node->right);
+        case NODE_CONDITION:
+            return is_hoistable(node->left) && is_hoistable(node->right);
+        default:
+            return 0;
+    }
+}
+
+static long count_operations(const Node* node) {
+    if (node == NULL || !is_operation(node)) {
+        return 0;
+    }
+    return 1 + count_operations(node->left) + count_operations(node->right);
+}
+
+// Operations in a statement list, counting both branches of an if. A nested while
+// contributes only its pre-header: its iterations are reported on its own line.
+static long count_statement_operations(const Node* first) {
+    long count = 0;
+    for (const Node* statement = first; statement != NULL; statement = statement->next) {
+        switch (statement->type) {
+            case NODE_EXPR_STMT:
+                count += count_operations(statement->left);
+                break;
+            case NODE_IF:
+                count += count_operations(statement->left) + count_statement_operations(statement->right->left);
+                if (statement->extra != NULL) {
+                    count += count_statement_operations(statement->extra->left);
+                }
+                break;
+            case NODE_WHILE:
+                for (const Node* hoist = statement->extra; hoist != NULL; hoist = hoist->next) {
+                    count += count_operations(hoist->left);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return count;
+}
+
+static long loop_iteration_operations(const Node* loop) {
+    return count_operations(loop->left) + count_statement_operations(loop->right->left);
+}
+
+static int strength_reduce(Node* node) {
+    if (node == NULL || !is_operation(node)) {
+        return 0;
+    }
+    int reduced = strength_reduce(node->left) + strength_reduce(node->right);
+    if (node->type != NODE_BINARY) {
+        return reduced;
+    }
+
+    int k;
+    if (node->op == TOKEN_MULTIPLY && (k = power_of_two_exponent(node->right)) > 0) {
+        node->type = NODE_SHIFT_LEFT;
+    } else if (node->op == TOKEN_MULTIPLY && (k = power_of_two_exponent(node->left)) > 0) {
+        node->type = NODE_SHIFT_LEFT;
+        node->left = node->right;
+    } else if (node->op == TOKEN_DIVIDE && (k = power_of_two_exponent(node->right)) > 0) {
+        node->type = NODE_SHIFT_DIV;
+    } else {
+        return reduced;
+    }
+    node->value = k;
+    node->right = NULL;
+    return reduced + 1;
+}
+
+// Numbers the loops in source order (in Node.value) and strength-reduces every
+// expression, crediting each reduction to the innermost enclosing loop.
+static void prepare_loops(Node* first, LoopReport* enclosing, OptimizationReport* report) {
+    for (Node* statement = first; statement != NULL; statement = statement->next) {
+        switch (statement->type) {
+            case NODE_EXPR_STMT: {
+                int reduced = strength_reduce(statement->left);
+                if (enclosing) enclosing->reduced += reduced; else report->reduced_outside_loops += reduced;
+                break;
+            }
+            case NODE_IF: {
+                int reduced = strength_reduce(statement->left);
+                if (enclosing) enclosing->reduced += reduced; else report->reduced_outside_loops += reduced;
+                prepare_loops(statement->right->left, enclosing, report);
+                if (statement->extra != NULL) {
+                    prepare_loops(statement->extra->left, enclosing, report);
+                }
+                break;
+            }
+            case NODE_WHILE: {
+                if (report->loop_count == report->loop_capacity) {
+                    int capacity = report->loop_capacity ? report->loop_capacity * 2 : 16;
+                    LoopReport* grown = (LoopReport*)parser_realloc(report->loops, report->loop_capacity * sizeof(LoopReport),
+                                                                    capacity * sizeof(LoopReport));
+                    if (!grown) {
+                        statement->value = -1; // Left unoptimized
+                        break;
+                    }
+                    report->loops = grown;
+                    report->loop_capacity = capacity;
+                }
+                statement->value = report->loop_count;
+                LoopReport* loop = &report->loops[report->loop_count++];
+                memset(loop, 0, sizeof(*loop));
+                loop->loop = statement;
+                loop->ops_before = loop_iteration_operations(statement);
+                loop->pre_header_end = &statement->extra;
+                loop->reduced = strength_reduce(statement->left);
+                prepare_loops(statement->right->left, loop, report);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+static void hoist_expression(Node** slot, LoopReport* loop, Arena* arena) {
+    Node* node = *slot;
+    if (node == NULL || !is_operation(node)) {
+        return;
+    }
+    if (!is_hoistable(node)) {
+        hoist_expression(&node->left, loop, arena);
+        hoist_expression(&node->right, loop, arena);
+        return;
+    }
+
+    Node* hoist = new_node(arena, NODE_HOIST, node->line, node->col);
+    Node* temp = new_node(arena, NODE_TEMP, node->line, node->col);
+    if (!hoist || !temp) {
+        return; // Out of memory: the expression simply stays in the loop
+    }
+    hoist->value = temp->value = g_temp_count++;
+    hoist->left = node;
+    *loop->pre_header_end = hoist;
+    loop->pre_header_end = &hoist->next;
+    loop->hoisted++;
+    *slot = temp;
+}
+
+static void hoist_statements(Node* first, LoopReport* loop, Arena* arena) {
+    for (Node* statement = first; statement != NULL; statement = statement->next) {
+        switch (statement->type) {
+            case NODE_EXPR_STMT:
+                hoist_expression(&statement->left, loop, arena);
+                break;
+            case NODE_IF:
+                hoist_expression(&statement->left, loop, arena);
+                hoist_statements(statement->right->left, loop, arena);
+                if (statement->extra != NULL) {
+                    hoist_statements(statement->extra->left, loop, arena);
+                }
+                break;
+            case NODE_WHILE:
+                // Already optimized; whatever it hoisted may move further out
+                for (Node* hoist = statement->extra; hoist != NULL; hoist = hoist->next) {
+                    hoist_expression(&hoist->left, loop, arena);
+                }
+                hoist_expression(&statement->left, loop, arena);
+                hoist_statements(statement->right->left, loop, arena);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Optimizes the loops in a statement list, innermost loops first
+static void optimize_loops(Node* first, OptimizationReport* report, Arena* arena) {
+    for (Node* statement = first; statement != NULL; statement = statement->next) {
+        if (statement->type == NODE_IF) {
+            optimize_loops(statement->right->left, report, arena);
+            if (statement->extra != NULL) {
+                optimize_loops(statement->extra->left, report, arena);
+            }
+        } else if (statement->type == NODE_WHILE) {
+            optimize_loops(statement->right->left, report, arena);
+            if (statement->value >= 0) {
+                LoopReport* loop = &report->loops[statement->value];
+                hoist_expression(&statement->left, loop, arena);
+                int condition_hoists = loop->hoisted;
+                hoist_statements(statement->right->left, loop, arena);
+                statement->value = condition_hoists;
+            } else {
+                statement->value = 0;
+            }
+        }
+    }
+}
+
+// Optimizes a program tree in place; new nodes come from arena. The caller frees
+// report->loops (loop_capacity entries) with parser_free().
+static void optimize_program(Node* tree, Arena* arena, OptimizationReport* report) {
+    memset(report, 0, sizeof(*report));
+    g_temp_count = 0;
+
+    prepare_loops(tree->left, NULL, report);
+    optimize_loops(tree->left, report, arena);
+    for (int i = 0; i < report->loop_count; i++) {
+        report->loops[i].ops_after = loop_iteration_operations(report->loops[i].loop);
+    }
+}
+
+// =============11. Loop Optimizer============== end
+
+// =============13. Library API============== start
+
+void parser_default_options(ParserOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->mode = PARSER_PARSE;
+    options->ltd_value = DEFAULT_LTD_VALUE;
+}
+
+static void export_error(const ParseError* error, ParserResult* result) {
+    ParserError* out = &result->error;
+    out->kind = error->kind;
+    snprintf(out->message, sizeof(out->message), "%s", error->message);
+    out->line = error->token.line;
+    out->col = error->token.col;
+    out->token_type = token_type_to_string(error->token.type);
+    snprintf(out->token, sizeof(out->token), "%s", error->token.value);
+    out->offset = (size_t)(error->source_ptr - error->source_code);
+
+    if (strcmp(error->kind, "Runtime") == 0) {
+        result->status = PARSER_RUNTIME_ERROR;
+    } else if (strcmp(error->kind, "Memory") == 0) {
+        result->status = PARSER_OUT_OF_MEMORY;
+    } else if (strcmp(error->kind, "Backend") == 0) {
+        result->status = PARSER_BACKEND_ERROR;
+    } else if (strcmp(error->kind, "Limit") == 0) {
+        result->status = error->limit;
+    } else {
+        result->status = PARSER_SYNTAX_ERROR;
+    }
+}
+
+// Copies the optimizer report into the result and releases it
+static void export_optimization_report(OptimizationReport* report, ParserResult* result) {
+    result->reduced = report->reduced_outside_loops;
+    result->temporaries = g_temp_count;
+    if (report->loop_count > 0) {
+        result->loops = (ParserLoopReport*)parser_alloc(report->loop_count * sizeof(ParserLoopReport));
+    }
+    for (int i = 0; i < report->loop_count; i++) {
+        const LoopReport* loop = &report->loops[i];
+        result->hoisted += loop->hoisted;
+        result->reduced += loop->reduced;
+        if (result->loops) {
+            ParserLoopReport* out = &result->loops[result->loop_count++];
+            out->line = loop->loop->line;
+            out->col = loop->loop->col;
+            out->ops_before = loop->ops_before;
+            out->ops_after = loop->ops_after;
+            out->hoisted = loop->hoisted;
+            out->reduced = loop->reduced;
+        }
+    }
+    parser_free(report->loops, report->loop_capacity * sizeof(LoopReport));
+}
+
+// Builds the syntax tree, optimizes and runs it as options ask. Returns 0 with *error
+// filled in if a phase failed.
+static int process_tree(const char* source, const ParserOptions* options, ParserResult* result, ParseError* error) {
+    Arena arena = {0};
+    DagTable dag = {NULL, 0, 0, 0};
+    Node* tree = NULL;
+    int build = options->mode == PARSER_EVALUATE || options->build_tree || options->optimize || options->hash_cons;
+    long long start = monotonic_ns();
+
+    TokenRing ring;
+    pthread_t lexer;
+    int pipelined = options->pipeline && start_pipeline(&ring, source, &lexer);
+
+    g_dag_table = build && options->hash_cons ? &dag : NULL;
+    g_token_ring = pipelined ? &ring : NULL;
+    int ok = parse_program_sequential(source, build ? &arena : NULL, &tree, error);
+    g_token_ring = NULL;
+    g_dag_table = NULL;
+    if (pipelined) {
+        stop_pipeline(&ring, lexer);
+        result->pipelined = 1;
+        result->lexer_stalls = ring.lexer_stalls;
+        result->lexer_stall_ns = ring.lexer_stall_ns;
+        result->parser_stalls = ring.parser_stalls;
+        result->parser_stall_ns = ring.parser_stall_ns;
+    }
+    result->parse_ns = monotonic_ns() - start;
+    result->tokens = g_token_count;
+    result->nodes = arena.node_count;
+    result->arena_bytes = arena.bytes;
+    if (options->hash_cons) {
+        result->expressions = dag.requests;
+        result->unique_expressions = dag.count;
+        result->saved_bytes = (dag.requests - dag.count) * ARENA_NODE_SIZE;
+    }
+    free_dag_table(&dag);
+
+    g_temp_count = 0;
+    if (ok && options->optimize && !options->hash_cons) {
+        OptimizationReport report;
+        start = monotonic_ns();
+        optimize_program(tree, &arena, &report);
+        export_optimization_report(&report, result);
+        result->optimize_ns = monotonic_ns() - start;
+    }
+    if (ok && options->mode == PARSER_EVALUATE && options->profile && !start_profile(tree, result)) {
+        ok = 0;
+        error->kind = "Memory";
+        snprintf(error->message, sizeof(error->message), "Memory allocation failed for the profile");
+        error->token = make_token(TOKEN_EOF, "", 1, 1);
+        error->source_code = source;
+        error->source_ptr = source;
+    }
+    // Memoized DAG nodes and profile counters are written while running, so those runs stay sequential
+    int eval_threads = options->hash_cons || options->profile ? 0 : options->eval_threads;
+    if (ok && options->mode == PARSER_EVALUATE && eval_threads > 1) {
+        result->barriers = analyze_dependencies(tree);
+    }
+    if (ok && options->mode == PARSER_EVALUATE) {
+        start = monotonic_ns();
+        g_profile = result->profile;
+        ok = run_program(tree, eval_threads, error);
+        g_profile = NULL;
+        long long end = monotonic_ns();
+        result->run_ns = end - start;
+        if (result->profile) finish_profile(result, end);
+        result->statements = g_exec_stats.statements;
+        result->operations = g_exec_stats.operations;
+        result->iterations = g_exec_stats.iterations;
+        result->value = g_exec_stats.last_value;
+        result->memo_hits = g_exec_stats.memo_hits;
+        result->eval_tasks = g_exec_stats.tasks;
+    }
+    arena_free(&arena);
+    free_symbol_table();
+    return ok;
+}
+
+// The calling thread's settings, which the caller's options replace for the duration of a call
+typedef struct {
+    const ParserAllocator *allocator;
+    FILE *trace;
+    int ltd_value;
+    long max_loop_iterations;
+    const Limits *limits;
+    Limits call_limits;     // ParserOptions.limits, with the deadline of this call
+    ParserOptions defaults; // Used when the caller passed no options
+} LibraryCall;
+
+// Applies *options (the defaults if NULL) to this thread and clears result
+static void begin_library_call(LibraryCall* call, const char* source, const ParserOptions** options,
+                               ParserResult* result) {
+    if (*options == NULL) {
+        parser_default_options(&call->defaults);
+        *options = &call->defaults;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->allocator = (*options)->allocator;
+    result->bytes = strlen(source);
+    result->prefilter_ns = result->parse_ns = result->optimize_ns = result->compile_ns = result->run_ns = -1;
+
+    const ParserLimits* limits = &(*options)->limits;
+    call->call_limits.max_depth = limits->max_depth;
+    call->call_limits.max_tokens = limits->max_tokens;
+    call->call_limits.max_arena_bytes = limits->max_arena_bytes;
+    call->call_limits.max_time_ns = limits->max_time_ns;
+    call->call_limits.deadline_ns = limits->max_time_ns > 0 ? monotonic_ns() + limits->max_time_ns : 0;
+
+    call->allocator = g_allocator;
+    call->trace = g_trace_stream;
+    call->ltd_value = g_ltd_value;
+    call->max_loop_iterations = g_max_loop_iterations;
+    call->limits = g_limits;
+    g_allocator = (*options)->allocator;
+    g_trace_stream = (*options)->trace;
+    g_ltd_value = (*options)->ltd_value;
+    g_max_loop_iterations = (*options)->max_loop_iterations > 0 ? (*options)->max_loop_iterations :
+                            DEFAULT_MAX_LOOP_ITERATIONS;
+    g_limits = limits->max_depth || limits->max_tokens || limits->max_arena_bytes || limits->max_time_ns > 0 ?
+               &call->call_limits : NULL;
+}
+
+static void end_library_call(const LibraryCall* call) {
+    g_allocator = call->allocator;
+    g_trace_stream = call->trace;
+    g_ltd_value = call->ltd_value;
+    g_max_loop_iterations = call->max_loop_iterations;
+    g_limits = call->limits;
+}
+
+// Fails the call at once if the source is longer than the limit
+static int check_input_limit(const char* source, const ParserOptions* options, const ParserResult* result,
+                             ParseError* error) {
+    if (options->limits.max_bytes == 0 || result->bytes <= options->limits.max_bytes) {
+        return 1;
+    }
+    error->kind = "Limit";
+    error->limit = PARSER_INPUT_LIMIT;
+    format_limit_message(error->message, sizeof(error->message), PARSER_INPUT_LIMIT, (long long)options->limits.max_bytes);
+    error->token = make_token(TOKEN_EOF, "", 1, 1);
+    error->source_code = source;
+    error->source_ptr = source;
+    return 0;
+}
+
+ParserStatus parser_process(const char* source, const ParserOptions* options, ParserResult* result) {
+    LibraryCall call;
+    begin_library_call(&call, source, &options, result);
+
+    StructuralIndex index = {NULL, 0, 0};
+    int parallel = options->mode == PARSER_PARSE && options->threads > 0;
+    ParseError error;
+    int ok = check_input_limit(source, options, result, &error);
+
+    if (ok && (options->prefilter || options->mode == PARSER_PREFILTER)) {
+        long long start = monotonic_ns();
+        ok = prefilter_source(source, parallel ? &index : NULL, &result->structural, &error);
+        result->prefilter_ns = monotonic_ns() - start;
+    }
+    if (ok && options->mode == PARSER_VALIDATE) {
+        long long start = monotonic_ns();
+        ok = validate_program(source, &error);
+        result->parse_ns = monotonic_ns() - start;
+        result->tokens = g_token_count;
+    } else if (ok && parallel) {
+        long long start = monotonic_ns();
+        ok = parse_program_parallel(source, &index, options->threads, &error, &result->ranges);
+        result->parse_ns = monotonic_ns() - start;
+        result->tokens = g_token_count;
+    } else if (ok && options->mode != PARSER_PREFILTER) {
+        ok = process_tree(source, options, result, &error);
+    }
+    free_structural_index(&index);
+    if (!ok) {
+        export_error(&error, result);
+    }
+
+    end_library_call(&call);
+    return result->status;
+}
+
+typedef struct {
+    const char* const *sources;
+    const ParserOptions *options;
+    ParserResult *results;
+    size_t count;
+    size_t next;           // Next input to hand out
+    size_t ok_count;
+    pthread_mutex_t lock;
+} BatchJob;
+
+static void* batch_worker(void* arg) {
+    BatchJob* job = (BatchJob*)arg;
+    size_t ok_count = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->count) {
+            break;
+        }
+        ok_count += parser_process(job->sources[i], job->options, &job->results[i]) == PARSER_OK;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->ok_count += ok_count;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+size_t parser_process_batch(const char* const* sources, size_t count, const ParserOptions* options,
+                            ParserResult* results) {
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    int thread_count = options ? options->batch_threads : 0;
+    BatchJob job;
+
+    if (thread_count > PARALLEL_MAX_THREADS) thread_count = PARALLEL_MAX_THREADS;
+    if ((size_t)thread_count > count) thread_count = (int)count;
+    memset(&job, 0, sizeof(job));
+    job.sources = sources;
+    job.options = options;
+    job.results = results;
+    job.count = count;
+    pthread_mutex_init(&job.lock, NULL);
+
+    // Inputs are handed out one at a time, so a few large ones do not hold up the rest;
+    // the calling thread is one of the workers.
+    int started = 0;
+    while (started + 1 < thread_count && pthread_create(&threads[started], NULL, batch_worker, &job) == 0) {
+        started++;
+    }
+    batch_worker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    return job.ok_count;
+}
+
+void parser_free_result(ParserResult* result) {
+    const ParserAllocator* saved_allocator = g_allocator;
+    g_allocator = result->allocator;
+    parser_free(result->loops, result->loop_count * sizeof(ParserLoopReport));
+    parser_free(result->profile, result->profile_count * sizeof(ParserProfileEntry));
+    g_allocator = saved_allocator;
+    result->loops = NULL;
+    result->loop_count = 0;
+    result->profile = NULL;
+    result->profile_count = 0;
+}
+
+static const char* const g_profile_kind_names[] = {"block", "expression", "if", "while"};
+
+void parser_write_profile(const ParserResult* result, FILE* out) {
+    long long total_ns = result->profile_count > 0 ? result->profile[0].ns : 0;
+    fprintf(out, "%-12s %-10s %10s %12s %12s %12s %7s\n",
+            "location", "kind", "count", "detail", "total ms", "self ms", "self %");
+    for (int i = 0; i < result->profile_count; i++) {
+        const ParserProfileEntry* entry = &result->profile[i];
+        char location[32];
+        char detail[32] = "";
+        snprintf(location, sizeof(location), "%d:%d", entry->line, entry->col);
+        if (entry->kind == PARSER_PROFILE_WHILE) {
+            snprintf(detail, sizeof(detail), "%ld iter", entry->iterations);
+        } else if (entry->kind == PARSER_PROFILE_IF) {
+            snprintf(detail, sizeof(detail), "%ld/%ld", entry->then_taken, entry->else_taken);
+        }
+        if (entry->kind == PARSER_PROFILE_BLOCK) {
+            fprintf(out, "%-12s %-10s %10ld %12s %12.3f %12.3f %6.1f%%\n", location, "block", entry->count, detail,
+                    entry->ns / 1e6, entry->self_ns / 1e6, total_ns > 0 ? 100.0 * entry->self_ns / total_ns : 0.0);
+        } else {
+            fprintf(out, "%-12s %-10s %10ld%s%12s\n", location, g_profile_kind_names[entry->kind], entry->count,
+                    detail[0] ? " " : "", detail);
+        }
+    }
+}
+
+// The frame of a block: "program", or the if, else or while it belongs to
+static void write_profile_frame(const ParserResult* result, const ParserProfileEntry* block, FILE* out) {
+    if (block->parent >= 0) {
+        write_profile_frame(result, &result->profile[block->parent], out);
+        fputc(';', out);
+    }
+    if (block->owner < 0) {
+        fputs("program", out);
+        return;
+    }
+    const ParserProfileEntry* owner = &result->profile[block->owner];
+    fprintf(out, "%s@%d:%d", owner->kind == PARSER_PROFILE_WHILE ? "while" : block->is_else ? "else" : "if",
+            owner->line, owner->col);
+}
+
+void parser_write_collapsed_stacks(const ParserResult* result, FILE* out) {
+    for (int i = 0; i < result->profile_count; i++) {
+        const ParserProfileEntry* entry = &result->profile[i];
+        if (entry->kind == PARSER_PROFILE_BLOCK && entry->self_ns > 0) {
+            write_profile_frame(result, entry, out);
+            fprintf(out, " %lld\n", entry->self_ns);
+        }
+    }
+}
+
+// =============13. Library API============== end
+
+// =============14. C Backend============== start
+// Translates a parsed program into a standalone C translation unit, and optionally
+// builds it with the system C compiler into a shared object that is loaded with
+// dlopen(). The unit defines
+//     int rdp_program(int* value, long* iterations, long error[3]);
+// which returns 0, or RDP_DIVISION_BY_ZERO / RDP_LOOP_LIMIT with the line, column and
+// line-start offset of the failing node in error[]. Every operation goes into its own
+// local in evaluation order, so errors come out in the same order as in the interpreter.
+
+#define RDP_DIVISION_BY_ZERO 1
+#define RDP_LOOP_LIMIT 2
+
+typedef struct {
+    FILE *out;
+    int temps;          // Locals named t1, t2, ... so far
+    int loops;          // Loop counters named n1, n2, ...
+} CEmitter;
+
+static void emit_indent(CEmitter* e, int depth) {
+    fprintf(e->out, "%*s", 4 * depth, "");
+}
+
+static void emit_error_return(CEmitter* e, const Node* node, int code, int depth) {
+    long offset = (long)(source_line_start(g_source_code, node->line) - g_source_code);
+    emit_indent(e, depth);
+    fprintf(e->out, "error[0] = %d; error[1] = %d; error[2] = %ld; return %s;\n", node->line, node->col, offset,
+            code == RDP_DIVISION_BY_ZERO ? "RDP_DIVISION_BY_ZERO" : "RDP_LOOP_LIMIT");
+}
+
+// Writes the operand for node into buffer, emitting the operations it needs first
+static void emit_expression(CEmitter* e, const Node* node, int depth, char* buffer, size_t size) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            if (node->value == INT32_MIN) {
+                snprintf(buffer, size, "(-2147483647 - 1)");
+            } else {
+                snprintf(buffer, size, "%d", node->value);
+            }
+            return;
+        case NODE_IDENTIFIER:
+            snprintf(buffer, size, "v_%s", g_symbol_table[node->value].name);
+            return;
+        case NODE_LTD:
+            snprintf(buffer, size, "ltd");
+            return;
+        case NODE_BINARY:
+        case NODE_CONDITION: {
+            char left[128], right[128];
+            emit_expression(e, node->left, depth, left, sizeof(left));
+            emit_expression(e, node->right, depth, right, sizeof(right));
+            int temp = ++e->temps;
+            if (node->op == TOKEN_DIVIDE && !(node->right->type == NODE_NUMBER && node->right->value != 0)) {
+                emit_indent(e, depth);
+                fprintf(e->out, "if (%s == 0) {\n", right);
+                emit_error_return(e, node, RDP_DIVISION_BY_ZERO, depth + 1);
+                emit_indent(e, depth);
+                fprintf(e->out, "}\n");
+            }
+            emit_indent(e, depth);
+            switch (node->op) {
+                // Overflow wraps and INT_MIN / -1 gives INT_MIN, as in compute_node()
+                case TOKEN_PLUS: fprintf(e->out, "int t%d = (int)((unsigned)%s + (unsigned)%s);\n", temp, left, right); break;
+                case TOKEN_MINUS: fprintf(e->out, "int t%d = (int)((unsigned)%s - (unsigned)%s);\n", temp, left, right); break;
+                case TOKEN_MULTIPLY: fprintf(e->out, "int t%d = (int)((unsigned)%s * (unsigned)%s);\n", temp, left, right); break;
+                case TOKEN_DIVIDE:
+                    fprintf(e->out, "int t%d = %s == -1 ? (int)(0u - (unsigned)%s) : %s / %s;\n",
+                            temp, right, left, left, right);
+                    break;
+                case TOKEN_EQ: fprintf(e->out, "int t%d = %s == %s;\n", temp, left, right); break;
+                case TOKEN_NEQ: fprintf(e->out, "int t%d = %s != %s;\n", temp, left, right); break;
+                case TOKEN_LT: fprintf(e->out, "int t%d = %s < %s;\n", temp, left, right); break;
+                case TOKEN_GT: fprintf(e->out, "int t%d = %s > %s;\n", temp, left, right); break;
+                case TOKEN_LTE: fprintf(e->out, "int t%d = %s <= %s;\n", temp, left, right); break;
+                case TOKEN_GTE: fprintf(e->out, "int t%d = %s >= %s;\n", temp, left, right); break;
+                default: fprintf(e->out, "int t%d = 0;\n", temp); break;
+            }
+            snprintf(buffer, size, "t%d", temp);
+            return;
+        }
+        default:
+            snprintf(buffer, size, "0");
+            return;
+    }
+}
+
+static void emit_block(CEmitter* e, const Node* block, int depth);
+
+static void emit_statement(CEmitter* e, const Node* node, int depth) {
+    char operand[128];
+    switch (node->type) {
+        case NODE_EXPR_STMT:
+            emit_expression(e, node->left, depth, operand, sizeof(operand));
+            emit_indent(e, depth);
+            fprintf(e->out, "*value = %s;\n", operand);
+            break;
+        case NODE_IF:
+            emit_expression(e, node->left, depth, operand, sizeof(operand));
+            emit_indent(e, depth);
+            fprintf(e->out, "if (%s) {\n", operand);
+            emit_block(e, node->right, depth + 1);
+            if (node->extra != NULL) {
+                emit_indent(e, depth);
+                fprintf(e->out, "} else {\n");
+                emit_block(e, node->extra, depth + 1);
+            }
+            emit_indent(e, depth);
+            fprintf(e->out, "}\n");
+            break;
+        case NODE_WHILE: {
+            int loop = ++e->loops;
+            emit_indent(e, depth);
+            fprintf(e->out, "long n%d = 0;\n", loop);
+            emit_indent(e, depth);
+            fprintf(e->out, "for (;;) {\n");
+            emit_expression(e, node->left, depth + 1, operand, sizeof(operand));
+            emit_indent(e, depth + 1);
+            fprintf(e->out, "if (!%s) break;\n", operand);
+            emit_indent(e, depth + 1);
+            fprintf(e->out, "if (++n%d > RDP_MAX_LOOP_ITERATIONS) {\n", loop);
+            emit_error_return(e, node, RDP_LOOP_LIMIT, depth + 2);
+            emit_indent(e, depth + 1);
+            fprintf(e->out, "}\n");
+            emit_indent(e, depth + 1);
+            fprintf(e->out, "++*iterations;\n");
+            emit_block(e, node->right, depth + 1);
+            emit_indent(e, depth);
+            fprintf(e->out, "}\n");
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void emit_block(CEmitter* e, const Node* block, int depth) {
+    for (const Node* statement = block->left; statement != NULL; statement = statement->next) {
+        emit_statement(e, statement, depth);
+    }
+}
+
+// Writes the translation unit for the tree that was just parsed (the symbol table
+// still holds its variables). Returns 0 if writing failed.
+static int emit_c_program(const Node* tree, FILE* out) {
+    CEmitter e = {out, 0, 0};
+
+    fprintf(out, "/* Translated by the recursive descent parser from a program of %lu bytes. */\n\n",
+            (unsigned long)strlen(g_source_code));
+    fprintf(out, "#define RDP_DIVISION_BY_ZERO %d\n", RDP_DIVISION_BY_ZERO);
+    fprintf(out, "#define RDP_LOOP_LIMIT %d\n", RDP_LOOP_LIMIT);
+    fprintf(out, "#define RDP_MAX_LOOP_ITERATIONS %ldL\n\n", g_max_loop_iterations);
+    fprintf(out, "int rdp_program(int *value, long *iterations, long error[3]) {\n");
+    fprintf(out, "    const int ltd = %d;\n", g_ltd_value);
+    for (int i = 0; i < g_symbol_count; i++) {
+        fprintf(out, "    const int v_%s = 0;\n", g_symbol_table[i].name);
+    }
+    fprintf(out, "    (void)ltd;\n");
+    fprintf(out, "    (void)error;\n");
+    fprintf(out, "    *value = 0;\n");
+    fprintf(out, "    *iterations = 0;\n");
+    emit_block(&e, tree, 1);
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n\n");
+
+    // Lets the unit be built into a program of its own with -DRDP_STANDALONE
+    fprintf(out, "#ifdef RDP_STANDALONE\n");
+    fprintf(out, "#include <stdio.h>\n\n");
+    fprintf(out, "int main(void) {\n");
+    fprintf(out, "    int value;\n");
+    fprintf(out, "    long iterations, error[3];\n");
+    fprintf(out, "    int status = rdp_program(&value, &iterations, error);\n");
+    fprintf(out, "    if (status != 0) {\n");
+    fprintf(out, "        fprintf(stderr, \"Runtime Error on line %%ld, col %%ld: %%s\\n\", error[0], error[1],\n");
+    fprintf(out, "                status == RDP_DIVISION_BY_ZERO ? \"Division by zero\" : \"Loop iteration limit exceeded (runaway while loop)\");\n");
+    fprintf(out, "        return 1;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    printf(\"%%d\\n\", value);\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "#endif\n");
+    return !ferror(out);
+}
+
+static void backend_error(ParseError* error, const char* source, const char* message, const char* detail) {
+    error->kind = "Backend";
+    snprintf(error->message, sizeof(error->message), "%s%s%s", message, detail ? ": " : "", detail ? detail : "");
+    error->token = make_token(TOKEN_ERROR, "", 0, 0);
+    error->source_code = source;
+    error->source_ptr = source;
+}
+
+// Parses source into a tree and writes its translation to out
+static int translate_program(const char* source, FILE* out, ParserResult* result, ParseError* error) {
+    Arena arena = {0};
+    Node* tree = NULL;
+    long long start = monotonic_ns();
+
+    int ok = parse_program_sequential(source, &arena, &tree, error);
+    result->parse_ns = monotonic_ns() - start;
+    result->tokens = g_token_count;
+    result->nodes = arena.node_count;
+    result->arena_bytes = arena.bytes;
+    if (ok && !emit_c_program(tree, out)) {
+        backend_error(error, source, "Could not write the C translation", NULL);
+        ok = 0;
+    }
+    arena_free(&arena);
+    free_symbol_table();
+    return ok;
+}
+
+extern char **environ; // Passed on to the C compiler
+
+// Runs compiler on c_path, with its diagnostics going to log_path.
+// Returns 1 if it built so_path, otherwise 0 with *error filled in.
+static int run_c_compiler(const char* compiler, const char* c_path, const char* so_path, const char* log_path,
+                          const char* source, ParseError* error) {
+    char* argv[] = {(char*)compiler, "-O2", "-shared", "-fPIC", "-o", (char*)so_path, (char*)c_path, NULL};
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+    int status = 0;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, log_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int spawned = posix_spawnp(&pid, compiler, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned != 0) {
+        backend_error(error, source, "Could not run the C compiler", strerror(spawned));
+        return 0;
+    }
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        return 1;
+    }
+
+    // The first line of the compiler's output says what went wrong
+    char diagnostic[160] = "";
+    FILE* log = fopen(log_path, "r");
+    if (log) {
+        if (fgets(diagnostic, sizeof(diagnostic), log)) {
+            diagnostic[strcspn(diagnostic, "\n")] = '\0';
+        }
+        fclose(log);
+    }
+    backend_error(error, source, "The C compiler failed", diagnostic[0] ? diagnostic : NULL);
+    return 0;
+}
+
+// Translates, compiles and loads source; the temporary files are removed again
+static int build_native(const char* source, const ParserOptions* options, ParserNative* native,
+                        ParserResult* result, ParseError* error) {
+    const char* directory = getenv("TMPDIR");
+    char c_path[256], so_path[256], log_path[256];
+    if (directory == NULL || *directory == '\0') directory = "/tmp";
+    snprintf(c_path, sizeof(c_path), "%s/rdp-XXXXXX.c", directory);
+
+    int fd = mkstemps(c_path, 2);
+    FILE* out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (out == NULL) {
+        if (fd >= 0) close(fd);
+        backend_error(error, source, "Could not create a temporary file", strerror(errno));
+        return 0;
+    }
+    int ok = translate_program(source, out, result, error);
+    if (fclose(out) != 0 && ok) {
+        backend_error(error, source, "Could not write the C translation", strerror(errno));
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(c_path);
+        return 0;
+    }
+
+    size_t base = strlen(c_path) - 2;
+    snprintf(so_path, sizeof(so_path), "%.*s.so", (int)base, c_path);
+    snprintf(log_path, sizeof(log_path), "%.*s.log", (int)base, c_path);
+    long long start = monotonic_ns();
+    ok = run_c_compiler(options->compiler ? options->compiler : "cc", c_path, so_path, log_path, source, error);
+    if (ok) {
+        native->handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+        native->program = native->handle ? (int (*)(int*, long*, long*))dlsym(native->handle, "rdp_program") : NULL;
+        if (native->program == NULL) {
+            backend_error(error, source, "Could not load the compiled program", dlerror());
+            parser_free_native(native);
+            ok = 0;
+        }
+    }
+    result->compile_ns = monotonic_ns() - start;
+    unlink(c_path);
+    unlink(so_path); // The loaded object stays mapped
+    unlink(log_path);
+    return ok;
+}
+
+ParserStatus parser_emit_c(const char* source, const ParserOptions* options, FILE* out, ParserResult* result) {
+    LibraryCall call;
+    ParseError error;
+
+    begin_library_call(&call, source, &options, result);
+    if (!check_input_limit(source, options, result, &error) || !translate_program(source, out, result, &error)) {
+        export_error(&error, result);
+    }
+    end_library_call(&call);
+    return result->status;
+}
+
+ParserStatus parser_compile_native(const char* source, const ParserOptions* options, ParserNative* native,
+                                   ParserResult* result) {
+    LibraryCall call;
+    ParseError error;
+
+    memset(native, 0, sizeof(*native));
+    begin_library_call(&call, source, &options, result);
+    if (!check_input_limit(source, options, result, &error) || !build_native(source, options, native, result, &error)) {
+        export_error(&error, result);
+    }
+    end_library_call(&call);
+    return result->status;
+}
+
+ParserStatus parser_run_native(const ParserNative* native, ParserResult* result) {
+    long error[3] = {0, 0, 0};
+
+    memset(result, 0, sizeof(*result));
+    result->prefilter_ns = result->parse_ns = result->optimize_ns = result->compile_ns = -1;
+    long long start = monotonic_ns();
+    int status = native->program(&result->value, &result->iterations, error);
+    result->run_ns = monotonic_ns() - start;
+    if (status != 0) {
+        ParserError* out = &result->error;
+        result->status = PARSER_RUNTIME_ERROR;
+        out->kind = "Runtime";
+        snprintf(out->message, sizeof(out->message), "%s", status == RDP_DIVISION_BY_ZERO ?
+                 "Division by zero" : "Loop iteration limit exceeded (runaway while loop)");
+        out->line = (int)error[0];
+        out->col = (int)error[1];
+        out->token_type = token_type_to_string(TOKEN_ERROR);
+        out->offset = (size_t)error[2];
+    }
+    return result->status;
+}
+
+void parser_free_native(ParserNative* native) {
+    if (native->handle) {
+        dlclose(native->handle);
+    }
+    native->handle = NULL;
+    native->program = NULL;
+}
+
+// =============14. C Backend============== end
+
+// =============16. Batch File Reader============== start
+// parser_process_files() reads many files with io_uring where the kernel offers it:
+// up to FILES_IN_FLIGHT files have their open, statx, read and close requests in the
+// kernel at once, and every file that has been read is handed to a pool of parser
+// workers straight away. No more than FILES_BUFFERED files wait for a worker, so
+// memory stays bounded when reading outpaces parsing. Regular files cannot be polled
+// with epoll, so without io_uring the workers read with open/fstat/pread themselves;
+// several blocking reads are then still in flight, one per worker.
+
+#define FILES_IN_FLIGHT 64
+#define URING_ENTRIES (2 * FILES_IN_FLIGHT) // Each file has at most two requests in the kernel (open and statx)
+#define FILES_BUFFERED 128
+#define FILE_MIN_BUFFER 4096
+
+typedef struct {
+    size_t index;       // Position in the caller's arrays
+    char *data;         // NUL-terminated contents
+    size_t length;
+    size_t capacity;    // Bytes allocated for data
+} ReadFile;
+
+typedef struct {
+    const char* const *paths;
+    const ParserOptions *options;
+    ParserResult *results;
+    size_t count;
+    size_t next;            // pread: next file to read; io_uring: next file to open
+    ReadFile *ready;        // io_uring: read files waiting for a worker (ring of FILES_BUFFERED)
+    size_t ready_head;
+    size_t ready_count;
+    int reading_done;       // io_uring: no more files will become ready
+    int use_pread;
+    size_t ok_count;
+    size_t bytes_read;
+    pthread_mutex_t lock;
+    pthread_cond_t file_ready; // Signalled when a file is queued or reading ends
+    pthread_cond_t slot_free;  // Signalled when a worker takes a file
+} FileJob;
+
+// The result of a file that could not be read, as parser_process() would lay it out
+static void file_error_result(const ParserOptions* options, const char* path, int error, ParserResult* result) {
+    memset(result, 0, sizeof(*result));
+    result->allocator = options->allocator;
+    result->prefilter_ns = result->parse_ns = result->optimize_ns = result->compile_ns = result->run_ns = -1;
+    result->status = PARSER_IO_ERROR;
+    result->error.kind = "IO";
+    snprintf(result->error.message, sizeof(result->error.message), "Could not read '%s': %s", path, strerror(error));
+    result->error.token_type = token_type_to_string(TOKEN_EOF);
+}
+
+// Reads the whole file the blocking way. Returns 0 or an errno value.
+static int pread_file(const char* path, ReadFile* file) {
+    struct stat info;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        return error;
+    }
+
+    size_t capacity = (size_t)info.st_size + 1 > FILE_MIN_BUFFER ? (size_t)info.st_size + 1 : FILE_MIN_BUFFER;
+    size_t length = 0;
+    char* data = (char*)parser_alloc(capacity);
+    int error = data ? 0 : ENOMEM;
+    while (error == 0) {
+        if (length + 1 == capacity) { // Larger than fstat said; keep going
+            char* grown = (char*)parser_realloc(data, capacity, capacity * 2);
+            if (!grown) {
+                error = ENOMEM;
+                break;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = pread(fd, data + length, capacity - 1 - length, (off_t)length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            error = errno;
+        } else if (n == 0) {
+            break;
+        } else {
+            length += (size_t)n;
+        }
+    }
+    close(fd);
+    if (error != 0) {
+        parser_free(data, capacity);
+        return error;
+    }
+    data[length] = '\0';
+    file->data = data;
+    file->length = length;
+    file->capacity = capacity;
+    return 0;
+}
+
+static void process_read_file(FileJob* job, ReadFile* file, size_t* ok_count) {
+    ParserResult* result = &job->results[file->index];
+    *ok_count += parser_process(file->data, job->options, result) == PARSER_OK;
+    parser_free(file->data, file->capacity);
+}
+
+static void* file_worker(void* arg) {
+    FileJob* job = (FileJob*)arg;
+    size_t ok_count = 0;
+    size_t bytes = 0;
+
+    g_allocator = job->options->allocator; // For the buffers freed here
+    for (;;) {
+        ReadFile file = {0, NULL, 0, 0};
+        pthread_mutex_lock(&job->lock);
+        if (job->use_pread) {
+            file.index = job->next++;
+            pthread_mutex_unlock(&job->lock);
+            if (file.index >= job->count) {
+                break;
+            }
+            int error = pread_file(job->paths[file.index], &file);
+            if (error != 0) {
+                file_error_result(job->options, job->paths[file.index], error, &job->results[file.index]);
+                continue;
+            }
+        } else {
+            while (job->ready_count == 0 && !job->reading_done) {
+                pthread_cond_wait(&job->file_ready, &job->lock);
+            }
+            if (job->ready_count == 0) {
+                pthread_mutex_unlock(&job->lock);
+                break;
+            }
+            file = job->ready[job->ready_head];
+            job->ready_head = (job->ready_head + 1) % FILES_BUFFERED;
+            job->ready_count--;
+            pthread_cond_signal(&job->slot_free);
+            pthread_mutex_unlock(&job->lock);
+        }
+        bytes += file.length;
+        process_read_file(job, &file, &ok_count);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->ok_count += ok_count;
+    job->bytes_read += bytes;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+#ifdef PARSER_HAVE_IO_URING
+// The submission and completion rings shared with the kernel (no liburing needed)
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned to_submit;     // Queued since the last io_uring_enter()
+} Uring;
+
+static void uring_close(Uring* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+static int uring_supports(int fd, const int* ops, int op_count) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    int ok = probe && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (int i = 0; ok && i < op_count; i++) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+// Returns 0 if io_uring is missing, forbidden or lacks the operations used here
+static int uring_open(Uring* ring, unsigned entries) {
+    static const int ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE};
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return 0;
+    }
+    if (!uring_supports(ring->fd, ops, 4)) {
+        uring_close(ring);
+        return 0;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        uring_close(ring);
+        return 0;
+    }
+    ring->cq_ring = ring->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            uring_close(ring);
+            return 0;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_close(ring);
+        return 0;
+    }
+
+    char* sq = (char*)ring->sq_ring;
+    char* cq = (char*)ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 1;
+}
+
+// Next free submission entry, cleared; the ring is sized so that it never runs out
+static struct io_uring_sqe* uring_sqe(Uring* ring, int op, unsigned long long user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)op;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return sqe;
+}
+
+// Submits what is queued and waits for at least one completion
+static int uring_submit_and_wait(Uring* ring) {
+    for (;;) {
+        long n = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n >= 0) {
+            ring->to_submit -= (unsigned)n;
+            return 1;
+        }
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+}
+
+// Where a file is in the open, statx, read, close sequence
+typedef struct {
+    size_t index;
+    int fd;
+    int pending;            // Requests of this file in the kernel
+    int error;              // errno of the first failure
+    struct statx info;
+    char *data;
+    size_t capacity;
+    size_t length;
+    int reading;            // The read phase has started
+    int closing;
+} UringFile;
+
+enum { URING_OPEN, URING_STATX, URING_READ, URING_CLOSE };
+
+#define URING_USER_DATA(slot, op) (((unsigned long long)(slot) << 2) | (op))
+
+static void uring_open_next(Uring* ring, const FileJob* job, UringFile* file, int slot) {
+    struct io_uring_sqe* sqe = uring_sqe(ring, IORING_OP_OPENAT, URING_USER_DATA(slot, URING_OPEN));
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long long)(uintptr_t)job->paths[file->index];
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    file->pending++;
+}
+
+static void uring_statx_next(Uring* ring, const FileJob* job, UringFile* file, int slot) {
+    struct io_uring_sqe* sqe = uring_sqe(ring, IORING_OP_STATX, URING_USER_DATA(slot, URING_STATX));
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long long)(uintptr_t)job->paths[file->index];
+    sqe->len = STATX_SIZE;
+    sqe->off = (unsigned long long)(uintptr_t)&file->info;
+    file->pending++;
+}
+
+static void uring_read_next(Uring* ring, UringFile* file, int slot) {
+    struct io_uring_sqe* sqe = uring_sqe(ring, IORING_OP_READ, URING_USER_DATA(slot, URING_READ));
+    sqe->fd = file->fd;
+    sqe->addr = (unsigned long long)(uintptr_t)(file->data + file->length);
+    sqe->len = (unsigned)(file->capacity - 1 - file->length);
+    sqe->off = file->length;
+    file->pending++;
+}
+
+static void uring_close_file(Uring* ring, UringFile* file, int slot) {
+    file->closing = 1;
+    if (file->fd >= 0) {
+        struct io_uring_sqe* sqe = uring_sqe(ring, IORING_OP_CLOSE, URING_USER_DATA(slot, URING_CLOSE));
+        sqe->fd = file->fd;
+        file->pending++;
+    }
+}
+
+// Hands a finished file to the workers, or records why it could not be read
+static void uring_finish_file(FileJob* job, UringFile* file) {
+    if (file->error != 0) {
+        parser_free(file->data, file->capacity);
+        file_error_result(job->options, job->paths[file->index], file->error, &job->results[file->index]);
+        return;
+    }
+    ReadFile ready = {file->index, file->data, file->length, file->capacity};
+    file->data[file->length] = '\0';
+    pthread_mutex_lock(&job->lock);
+    while (job->ready_count == FILES_BUFFERED) {
+        pthread_cond_wait(&job->slot_free, &job->lock);
+    }
+    job->ready[(job->ready_head + job->ready_count) % FILES_BUFFERED] = ready;
+    job->ready_count++;
+    pthread_cond_signal(&job->file_ready);
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Moves a file on after one of its requests completed
+static void uring_step(Uring* ring, const FileJob* job, UringFile* file, int slot, int op, int res) {
+    file->pending--;
+    if (op == URING_CLOSE) {
+        return;
+    }
+    if ((res == -EINTR || res == -EAGAIN) && !file->error && !file->closing) {
+        // Interrupted: ask again (a read is asked again below, at the same offset)
+        if (op == URING_OPEN) {
+            uring_open_next(ring, job, file, slot);
+            return;
+        }
+        if (op == URING_STATX) {
+            uring_statx_next(ring, job, file, slot);
+            return;
+        }
+    } else if (res < 0 && !file->error) {
+        file->error = -res;
+    } else if (op == URING_OPEN && res >= 0) {
+        file->fd = res;
+    } else if (op == URING_READ && res >= 0) {
+        file->length += (size_t)res;
+        // The end of the file, or all statx reported: done
+        if (res == 0 || file->length == file->info.stx_size) {
+            uring_close_file(ring, file, slot);
+            return;
+        }
+    }
+    if (file->pending > 0 || file->closing) {
+        return;
+    }
+    if (file->error != 0) {
+        uring_close_file(ring, file, slot);
+        return;
+    }
+
+    if (!file->reading) {
+        // Open and statx are both done: read the size statx reported, plus one byte to see the end
+        file->reading = 1;
+        file->capacity = file->info.stx_size + 1 > FILE_MIN_BUFFER ? file->info.stx_size + 1 : FILE_MIN_BUFFER;
+        file->data = (char*)parser_alloc(file->capacity);
+    } else if (file->length + 1 == file->capacity) { // Larger than statx said; keep going
+        char* grown = (char*)parser_realloc(file->data, file->capacity, file->capacity * 2);
+        if (grown) {
+            file->data = grown;
+            file->capacity *= 2;
+        } else {
+            parser_free(file->data, file->capacity);
+            file->data = NULL;
+        }
+    }
+    if (!file->data) {
+        file->capacity = 0;
+        file->error = ENOMEM;
+        uring_close_file(ring, file, slot);
+        return;
+    }
+    uring_read_next(ring, file, slot);
+}
+
+// Reads every file through ring, opened with URING_ENTRIES entries, on the calling
+// thread, and closes the ring->
+static void uring_read_files(FileJob* job, Uring* ring) {
+    UringFile files[FILES_IN_FLIGHT];
+    int free_slots[FILES_IN_FLIGHT];
+    int free_count = FILES_IN_FLIGHT;
+
+    for (int i = 0; i < FILES_IN_FLIGHT; i++) {
+        free_slots[i] = FILES_IN_FLIGHT - 1 - i;
+    }
+
+    size_t done = 0;
+    while (done < job->count) {
+        while (free_count > 0 && job->next < job->count) {
+            int slot = free_slots[--free_count];
+            UringFile* file = &files[slot];
+            memset(file, 0, sizeof(*file));
+            file->index = job->next++;
+            file->fd = -1;
+            uring_open_next(ring, job, file, slot);
+            uring_statx_next(ring, job, file, slot);
+        }
+
+        if (!uring_submit_and_wait(ring)) {
+            break; // Unexpected; the files still in flight are reported as errors below
+        }
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            int slot = (int)(cqe->user_data >> 2);
+            UringFile* file = &files[slot];
+            uring_step(ring, job, file, slot, (int)(cqe->user_data & 3), cqe->res);
+            if (file->closing && file->pending == 0) {
+                uring_finish_file(job, file);
+                free_slots[free_count++] = slot;
+                done++;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (done < job->count) {
+        // io_uring_enter() failed: close the ring (which cancels its requests) and
+        // let the files that were still open or not started fail
+        uring_close(ring);
+        for (int i = 0; i < FILES_IN_FLIGHT; i++) {
+            int in_use = 1;
+            for (int j = 0; j < free_count; j++) in_use &= free_slots[j] != i;
+            if (in_use) {
+                if (files[i].fd >= 0) close(files[i].fd);
+                parser_free(files[i].data, files[i].capacity);
+                file_error_result(job->options, job->paths[files[i].index], EIO, &job->results[files[i].index]);
+            }
+        }
+        for (; job->next < job->count; job->next++) {
+            file_error_result(job->options, job->paths[job->next], EIO, &job->results[job->next]);
+        }
+        return;
+    }
+    uring_close(ring);
+}
+#endif // PARSER_HAVE_IO_URING
+
+size_t parser_process_files(const char* const* paths, size_t count, const ParserOptions* options,
+                            ParserResult* results, ParserFileStats* stats) {
+    ParserOptions defaults;
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    ReadFile ready[FILES_BUFFERED];
+    FileJob job;
+    long long start = monotonic_ns();
+
+    if (options == NULL) {
+        parser_default_options(&defaults);
+        options = &defaults;
+    }
+    memset(&job, 0, sizeof(job));
+    job.paths = paths;
+    job.options = options;
+    job.results = results;
+    job.count = count;
+    job.ready = ready;
+    job.use_pread = 1;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.file_ready, NULL);
+    pthread_cond_init(&job.slot_free, NULL);
+
+    const ParserAllocator* saved_allocator = g_allocator;
+    g_allocator = options->allocator;
+#ifdef PARSER_HAVE_IO_URING
+    // The ring is opened at its full size here, so that a ring the limits do not
+    // allow (RLIMIT_MEMLOCK, for one) means pread from the start
+    Uring ring;
+    if (!options->use_pread && uring_open(&ring, URING_ENTRIES)) {
+        job.use_pread = 0;
+    }
+#endif
+
+    // With io_uring the calling thread reads and every worker parses; with pread the
+    // calling thread is one of the workers
+    int thread_count = options->batch_threads > 0 ? options->batch_threads : 1;
+    if (thread_count > PARALLEL_MAX_THREADS) thread_count = PARALLEL_MAX_THREADS;
+    if (job.use_pread && (size_t)thread_count > count) thread_count = count > 0 ? (int)count : 1;
+    int first = job.use_pread ? 1 : 0;
+    int started = 0;
+    while (first + started < thread_count && pthread_create(&threads[started], NULL, file_worker, &job) == 0) {
+        started++;
+    }
+#ifdef PARSER_HAVE_IO_URING
+    if (!job.use_pread && started == 0) {
+        uring_close(&ring);
+        job.use_pread = 1; // No worker thread: read and parse on this one
+    }
+    if (!job.use_pread) {
+        uring_read_files(&job, &ring);
+        pthread_mutex_lock(&job.lock);
+        job.reading_done = 1;
+        pthread_cond_broadcast(&job.file_ready);
+        pthread_mutex_unlock(&job.lock);
+    }
+#endif
+    if (job.use_pread) {
+        file_worker(&job);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    g_allocator = saved_allocator;
+
+    if (stats) {
+        stats->io_uring = !job.use_pread;
+        stats->workers = job.use_pread ? started + 1 : started;
+        stats->bytes = job.bytes_read;
+        stats->ns = monotonic_ns() - start;
+    }
+    pthread_cond_destroy(&job.slot_free);
+    pthread_cond_destroy(&job.file_ready);
+    pthread_mutex_destroy(&job.lock);
+    return job.ok_count;
+}
+
+// =============16. Batch File Reader============== end
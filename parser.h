@@ -0,0 +1,226 @@
+// parser.h
+// Recursive Descent Parser for Control Structures and Nested Expressions
+// Library interface: parse, validate or evaluate programs held in memory.
+// Course: Programming Languages and Structures
+// Code by: Md. Alamin
+// Student ID: 134
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Memory hooks. Every block the library allocates is returned through free with the
+// size it was allocated with. Hooks passed to parser_process_batch() or _files() with
+// more than one thread, or with eval_threads, are called from several threads at once.
+typedef struct {
+    void* (*alloc)(size_t size, void* context); // Returns NULL when out of memory
+    void (*free)(void* memory, size_t size, void* context);
+    void *context;
+} ParserAllocator;
+
+typedef enum {
+    PARSER_OK,
+    PARSER_SYNTAX_ERROR,  // Includes lexical errors and pre-filter rejections
+    PARSER_RUNTIME_ERROR, // Raised while evaluating (division by zero, runaway loop)
+    PARSER_OUT_OF_MEMORY,
+    PARSER_BACKEND_ERROR, // The C backend could not write, compile or load the translation
+    PARSER_DEPTH_LIMIT,   // ParserLimits exceeded, one status per limit
+    PARSER_TOKEN_LIMIT,
+    PARSER_INPUT_LIMIT,
+    PARSER_TIME_LIMIT,
+    PARSER_ARENA_LIMIT,
+    PARSER_IO_ERROR       // parser_process_files() could not open or read the file
+} ParserStatus;
+
+typedef enum {
+    PARSER_PREFILTER, // Only the structural pre-filter (brackets, comments, characters)
+    PARSER_VALIDATE,  // Valid or not, with the validate-only engine
+    PARSER_PARSE,     // The recursive descent parser
+    PARSER_EVALUATE   // Parse, then execute the program
+} ParserMode;
+
+// Budgets for one call; 0 means unlimited. The call fails as soon as one runs out.
+typedef struct {
+    int max_depth;              // '{' and '(' open at once
+    long max_tokens;            // Tokens scanned (per range for a parallel parse)
+    size_t max_bytes;           // Length of the source, checked before anything else
+    long long max_time_ns;      // Wall-clock time of the call, checked every 1024 tokens or loop iterations
+    size_t max_arena_bytes;     // Syntax tree
+} ParserLimits;
+
+typedef struct {
+    ParserMode mode;
+    int prefilter;                     // Run the pre-filter before the other phases
+    int threads;                       // PARSER_PARSE: split the program across this many threads (0: sequential).
+                                       // Such a parse only checks the program: no tree is built, and
+                                       // build_tree, optimize, hash_cons and pipeline are ignored
+    int build_tree;                    // PARSER_PARSE: build the syntax tree (node counts in the result)
+    int optimize;                      // Hoist loop invariants and strength-reduce the tree (builds it)
+    int hash_cons;                     // Share identical subexpressions in a DAG whose evaluation is
+                                       // memoized (builds it; optimize is then ignored)
+    int pipeline;                      // PARSER_PARSE/EVALUATE without threads: lex on a second thread
+                                       // that feeds the parser through a bounded token ring
+    int profile;                       // PARSER_EVALUATE: count statements and branches, time blocks
+    int eval_threads;                  // PARSER_EVALUATE: run independent statements of large blocks on
+                                       // this many threads (not with hash_cons or profile)
+    int batch_threads;                 // parser_process_batch()/_files(): process inputs on this many threads
+    int use_pread;                     // parser_process_files(): read with pread even where io_uring works
+    int ltd_value;                     // Value of the LTD keyword
+    long max_loop_iterations;          // PARSER_EVALUATE and native code: a while loop running longer
+                                       // is a runaway, a runtime error (0: 1000000)
+    FILE *trace;                       // Sequential parses print their trace here when not NULL
+    const ParserAllocator *allocator;  // NULL: malloc and free
+    const char *compiler;              // parser_compile_native(): C compiler to run (NULL: "cc")
+    ParserLimits limits;
+} ParserOptions;
+
+// An error as a value: what the parser reported and where.
+typedef struct {
+    const char *kind;       // "Syntax", "Runtime", "Memory", "Backend", "Limit" or "IO"
+    char message[256];
+    int line;
+    int col;
+    const char *token_type; // Type of the token the error was reported at
+    char token[100];        // Its text
+    size_t offset;          // Lexer position in the source when the error was raised
+} ParserError;
+
+typedef struct {
+    int line;               // Position of the while keyword
+    int col;
+    long ops_before;        // Operations per iteration before optimization
+    long ops_after;         // Operations per iteration after optimization
+    int hoisted;
+    int reduced;
+} ParserLoopReport;
+
+typedef enum {
+    PARSER_PROFILE_BLOCK,      // The program or the block of an if, else or while
+    PARSER_PROFILE_EXPRESSION, // An expression statement
+    PARSER_PROFILE_IF,
+    PARSER_PROFILE_WHILE
+} ParserProfileKind;
+
+// What profiling found at one block or statement.
+typedef struct {
+    ParserProfileKind kind;
+    int line;               // Position of the statement's first token, or of the block's '{'
+    int col;
+    int parent;             // Index of the enclosing block, -1 for the program
+    int owner;              // Blocks: index of their if or while, -1 for the program
+    int is_else;            // Blocks: the else-block of owner
+    long count;             // Times executed; blocks: times entered
+    long iterations;        // while: iterations
+    long then_taken;        // if: times the condition held
+    long else_taken;        // if: times it did not, with or without an else-block
+    long long ns;           // Blocks: cumulative time inside, nested blocks included
+    long long self_ns;      // Blocks: the same without nested blocks
+} ParserProfileEntry;
+
+typedef struct {
+    ParserStatus status;
+    ParserError error;      // Set when status is not PARSER_OK
+
+    size_t bytes;           // Length of the source
+    long tokens;            // Tokens scanned, including EOF
+    size_t structural;      // Structural characters ({ } ( ) ;) the pre-filter passed
+    int ranges;             // Ranges a parallel parse used
+    size_t nodes;           // Syntax tree after parsing (0 when no tree was built)
+    size_t arena_bytes;
+    size_t expressions;        // hash_cons: expression nodes in the source
+    size_t unique_expressions; // hash_cons: distinct nodes kept for them
+    size_t saved_bytes;        // hash_cons: arena bytes the sharing saved
+    int pipelined;             // The lexer ran on its own thread
+    long lexer_stalls;         // Waits of the lexer on a full ring and of the parser on an empty one
+    long long lexer_stall_ns;
+    long parser_stalls;
+    long long parser_stall_ns;
+
+    ParserLoopReport *loops; // Optimizer report in source order; release with parser_free_result()
+    int loop_count;
+    int hoisted;             // Totals over all loops
+    int reduced;             // Including reductions outside loops
+    int temporaries;
+
+    long statements;         // Execution statistics of PARSER_EVALUATE
+    long operations;
+    long iterations;
+    int value;               // Value of the last expression statement
+    long memo_hits;          // hash_cons: operations answered from a memoized value
+    long eval_tasks;         // eval_threads: tasks the statements were split into
+    int barriers;            // eval_threads: statements that had to wait for the ones before them
+    ParserProfileEntry *profile; // profile: one entry per block and statement in source order,
+    int profile_count;           // the program's block first; release with parser_free_result()
+
+    long long prefilter_ns;  // Time spent in each phase, -1 for phases that did not run
+    long long parse_ns;      // Validation or parsing
+    long long optimize_ns;
+    long long compile_ns;    // C compiler and dlopen() of parser_compile_native()
+    long long run_ns;
+
+    const ParserAllocator *allocator; // Owner of loops
+} ParserResult;
+
+// The clock of the phase timings in ParserResult, in nanoseconds
+long long parser_monotonic_ns(void);
+
+// Fills in the defaults: PARSER_PARSE, LTD 134, no trace, malloc and free.
+void parser_default_options(ParserOptions* options);
+
+// Processes one NUL-terminated program. options may be NULL for the defaults.
+// Never prints (except the trace when requested) and never exits.
+ParserStatus parser_process(const char* source, const ParserOptions* options, ParserResult* result);
+
+// Processes count programs, storing one result per program. Returns how many are PARSER_OK.
+size_t parser_process_batch(const char* const* sources, size_t count, const ParserOptions* options,
+                            ParserResult* results);
+
+typedef struct {
+    int io_uring;           // Files were read through io_uring rather than pread
+    int workers;            // Threads that parsed
+    size_t bytes;           // Bytes read
+    long long ns;           // Wall-clock time of the whole call
+} ParserFileStats;
+
+// Reads and processes count files, one result per file in the order of paths. While
+// files are still being read, the ones already read are parsed on batch_threads
+// workers. Files that cannot be read get PARSER_IO_ERROR. stats may be NULL.
+// Returns how many are PARSER_OK.
+size_t parser_process_files(const char* const* paths, size_t count, const ParserOptions* options,
+                            ParserResult* results, ParserFileStats* stats);
+
+// Releases what a result owns; the result itself belongs to the caller.
+void parser_free_result(ParserResult* result);
+
+// Writes the profile of a result as a table with one line per block and statement.
+void parser_write_profile(const ParserResult* result, FILE* out);
+
+// Writes the self time of every block as collapsed stacks ("program;while@3:5;if@4:9 ns"),
+// the input format of flame graph tools such as flamegraph.pl.
+void parser_write_collapsed_stacks(const ParserResult* result, FILE* out);
+
+// A program compiled to native code by parser_compile_native().
+typedef struct {
+    void *handle;                                            // dlopen() handle
+    int (*program)(int* value, long* iterations, long error[3]); // rdp_program() of the translation
+} ParserNative;
+
+// Writes a standalone C translation of the program to out. It defines
+// int rdp_program(int* value, long* iterations, long error[3]), with LTD as a
+// constant and the variables as zero-initialised locals, and a main() when built
+// with -DRDP_STANDALONE.
+ParserStatus parser_emit_c(const char* source, const ParserOptions* options, FILE* out, ParserResult* result);
+
+// Translates the program, builds it into a shared object with options->compiler and
+// loads it. The temporary files are removed; the code stays loaded until parser_free_native().
+ParserStatus parser_compile_native(const char* source, const ParserOptions* options, ParserNative* native,
+                                   ParserResult* result);
+
+// Runs a compiled program: value, iterations and run_ns, or a runtime error like PARSER_EVALUATE's.
+ParserStatus parser_run_native(const ParserNative* native, ParserResult* result);
+
+void parser_free_native(ParserNative* native);
+
+#endif // PARSER_H